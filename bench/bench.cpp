@@ -0,0 +1,363 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+// Plays scripted games on the headless engine, starting at each of the 32
+// level layouts, for every combination of the capabilities that change the
+// output. The results are written as JSON, and can be compared against a
+// baseline to catch any regressions in the output size. With --verify, the
+// output is also fed through the VT emulator, and the final screen for each
+// level is checked against the screen model, and against the other encoders
+// with the same color mode. The profiles using REP are also checked against
+// the same profile without it, and the difference in size is reported.
+
+#include "counting_sink.h"
+
+#include "allocations.h"
+#include "capabilities.h"
+#include "emulator.h"
+#include "font.h"
+#include "game.h"
+#include "options.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+    constexpr auto level_count = 32;
+    constexpr auto moves_per_level = 500;
+    constexpr auto steps_per_level = 5000;
+    // Byte counts are deterministic, so any increase at all is a regression,
+    // but we allow for the rounding in the JSON output.
+    constexpr auto tolerance = 0.01;
+
+    // A small LCG, so the scripted key presses are the same on every run.
+    class script {
+    public:
+        explicit script(const uint32_t seed)
+            : _state{seed}
+        {
+        }
+
+        key next_key()
+        {
+            static constexpr auto keys = std::to_array({key::up, key::down, key::left, key::right});
+            if (_next() % 6 != 0) return key::none;
+            return keys[_next() % keys.size()];
+        }
+
+    private:
+        uint32_t _next()
+        {
+            _state = _state * 1664525u + 1013904223u;
+            return _state >> 16;
+        }
+
+        uint32_t _state;
+    };
+
+    struct profile {
+        const char* name;
+        bool color;
+        bool eight_bit;
+        bool macros;
+        bool rep;
+    };
+
+    // REP is only offered by terminals outside the DEC range, so rather than
+    // doubling the table, we just add it to the smallest and largest of the
+    // capability sets in each color mode.
+    constexpr auto profiles = std::to_array<profile>({
+        {"mono-7bit", false, false, false, false},
+        {"mono-7bit-macros", false, false, true, false},
+        {"mono-8bit", false, true, false, false},
+        {"mono-8bit-macros", false, true, true, false},
+        {"color-7bit", true, false, false, false},
+        {"color-7bit-macros", true, false, true, false},
+        {"color-8bit", true, true, false, false},
+        {"color-8bit-macros", true, true, true, false},
+        {"mono-7bit-rep", false, false, false, true},
+        {"mono-8bit-macros-rep", false, true, true, true},
+        {"color-7bit-rep", true, false, false, true},
+        {"color-8bit-macros-rep", true, true, true, true},
+    });
+
+    // The profile with the same capabilities, but without REP.
+    size_t without_rep(const size_t index)
+    {
+        const auto& profile = profiles[index];
+        for (auto i = size_t{0}; i < profiles.size(); i++) {
+            const auto& other = profiles[i];
+            if (!other.rep && other.color == profile.color && other.eight_bit == profile.eight_bit && other.macros == profile.macros)
+                return i;
+        }
+        return index;
+    }
+
+    struct result {
+        const char* name;
+        uint64_t moves = 0;
+        uint64_t move_bytes = 0;
+        uint64_t move_allocations = 0;
+        uint64_t move_nanoseconds = 0;
+        uint64_t level_inits = 0;
+        uint64_t init_bytes = 0;
+        uint64_t init_allocations = 0;
+        int failed_levels = 0;
+        std::vector<std::vector<emulated_cell>> final_screens;
+
+        double bytes_per_move() const
+        {
+            return moves ? double(move_bytes) / moves : 0;
+        }
+
+        double bytes_per_level_init() const
+        {
+            return level_inits ? double(init_bytes) / level_inits : 0;
+        }
+
+        double cpu_ns_per_frame() const
+        {
+            return moves ? double(move_nanoseconds) / moves : 0;
+        }
+
+        double allocations_per_move() const
+        {
+            return moves ? double(move_allocations) / moves : 0;
+        }
+
+        double allocations_per_level_init() const
+        {
+            return level_inits ? double(init_allocations) / level_inits : 0;
+        }
+    };
+
+    result run_profile(const profile& profile, const bool verify)
+    {
+        auto caps = capabilities{capabilities::headless};
+        caps.has_soft_fonts = true;
+        caps.has_color = profile.color;
+        caps.has_8bit = profile.eight_bit;
+        caps.has_macros = profile.macros;
+        caps.has_rep = profile.rep;
+        caps.has_rectangle_ops = true;
+        caps.terminal_id = 65;
+        auto options = ::options{};
+        options.color = profile.color;
+
+        auto emulator = vt_emulator{caps.height, caps.width};
+        auto sink = counting_sink{verify ? &emulator : nullptr};
+        auto font = soft_font{caps, sink};
+        auto totals = result{profile.name};
+        for (auto wave = 1; wave <= level_count; wave++) {
+            options.wave = wave;
+            auto keys = script{static_cast<uint32_t>(wave)};
+            auto initialized = false;
+            auto moves = 0;
+            sink.bytes = 0;
+            const auto start_allocations = allocation_counter::count();
+            auto session = game{caps, options, font, sink};
+            for (auto step = 0; step < steps_per_level && moves < moves_per_level && !session.over(); step++) {
+                const auto bytes = sink.bytes;
+                const auto allocations = allocation_counter::count();
+                const auto start_time = std::chrono::steady_clock::now();
+                const auto result = session.step(keys.next_key());
+                const auto elapsed = std::chrono::steady_clock::now() - start_time;
+                if (result.steady) {
+                    // Everything before the first move counts as the level
+                    // initialization, including the snake's entrance.
+                    if (!initialized) {
+                        totals.level_inits++;
+                        totals.init_bytes += bytes;
+                        totals.init_allocations += allocations - start_allocations;
+                        initialized = true;
+                    }
+                    moves++;
+                    totals.moves++;
+                    totals.move_bytes += sink.bytes - bytes;
+                    totals.move_allocations += allocation_counter::count() - allocations;
+                    totals.move_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+                }
+                if (result.wave_complete) break;
+            }
+            if (verify) {
+                if (const auto mismatches = emulator.mismatches(session.snapshot())) {
+                    std::cerr << profile.name << " wave " << wave << ": " << mismatches << " cells differ from the screen model\n";
+                    totals.failed_levels++;
+                }
+                totals.final_screens.push_back(emulator.cells());
+            }
+        }
+        return totals;
+    }
+
+    // Encoders with the same color mode should leave the terminal in exactly
+    // the same state, however many bytes they take to get there. Each profile
+    // is compared with the first one in its color mode, and the ones using
+    // REP are also compared with the same profile without it.
+    bool compare_encoders(std::vector<result>& results)
+    {
+        auto passed = true;
+        const auto compare_screens = [&](const size_t i, const size_t j) {
+            for (auto level = size_t{0}; level < results[i].final_screens.size(); level++) {
+                const auto& screen = results[i].final_screens[level];
+                const auto& reference = results[j].final_screens[level];
+                const auto differences = std::inner_product(screen.begin(), screen.end(), reference.begin(), 0, std::plus<>{}, std::not_equal_to<>{});
+                if (differences) {
+                    std::cerr << results[i].name << " wave " << level + 1 << ": " << differences << " cells differ from " << results[j].name << "\n";
+                    passed = false;
+                }
+            }
+        };
+        for (auto i = size_t{0}; i < results.size(); i++) {
+            passed &= results[i].failed_levels == 0;
+            for (auto j = size_t{0}; j < i; j++) {
+                if (profiles[i].color != profiles[j].color) continue;
+                compare_screens(i, j);
+                break;
+            }
+            if (profiles[i].rep) compare_screens(i, without_rep(i));
+        }
+        return passed;
+    }
+
+    // How many bytes REP saves, compared with the same profile without it.
+    void report_rep_savings(const std::vector<result>& results)
+    {
+        std::fprintf(stderr, "%-22s %-27s %10s %10s\n", "profile", "metric", "no rep", "rep");
+        for (auto i = size_t{0}; i < results.size(); i++) {
+            if (!profiles[i].rep) continue;
+            const auto& reference = results[without_rep(i)];
+            const auto& result = results[i];
+            std::fprintf(stderr, "%-22s %-27s %10.2f %10.2f\n", result.name, "bytes_per_move", reference.bytes_per_move(),
+                         result.bytes_per_move());
+            std::fprintf(stderr, "%-22s %-27s %10.2f %10.2f\n", result.name, "bytes_per_level_init",
+                         reference.bytes_per_level_init(), result.bytes_per_level_init());
+        }
+    }
+
+    void write_json(std::ostream& out, const std::vector<result>& results)
+    {
+#ifdef NDEBUG
+        constexpr auto allocations_counted = false;
+#else
+        constexpr auto allocations_counted = true;
+#endif
+        out << "{\n";
+        out << "  \"levels\": " << level_count << ",\n";
+        out << "  \"moves_per_level\": " << moves_per_level << ",\n";
+        out << "  \"allocations_counted\": " << (allocations_counted ? "true" : "false") << ",\n";
+        out << "  \"profiles\": [\n";
+        for (auto i = size_t{0}; i < results.size(); i++) {
+            const auto& result = results[i];
+            // Without allocation counts, we write nulls rather than zeros that
+            // could be mistaken for real measurements.
+            char allocations[128] = "\"allocations_per_move\": null, \"allocations_per_level_init\": null";
+            if (allocations_counted)
+                std::snprintf(allocations, sizeof(allocations),
+                              "\"allocations_per_move\": %.2f, \"allocations_per_level_init\": %.2f",
+                              result.allocations_per_move(), result.allocations_per_level_init());
+            char line[512];
+            std::snprintf(line, sizeof(line),
+                          "    {\"name\": \"%s\", \"moves\": %llu, \"bytes_per_move\": %.2f, "
+                          "\"bytes_per_level_init\": %.2f, \"cpu_ns_per_frame\": %.0f, %s}%s\n",
+                          result.name, static_cast<unsigned long long>(result.moves), result.bytes_per_move(),
+                          result.bytes_per_level_init(), result.cpu_ns_per_frame(), allocations,
+                          i + 1 < results.size() ? "," : "");
+            out << line;
+        }
+        out << "  ]\n";
+        out << "}\n";
+    }
+
+    // The baseline is our own output, so rather than a general JSON parser,
+    // we just look for each value after the profile name it belongs to.
+    double find_value(const std::string& json, const std::string_view name, const std::string_view key)
+    {
+        const auto profile = json.find("\"name\": \"" + std::string{name} + "\"");
+        if (profile == std::string::npos) return -1;
+        const auto end = json.find('}', profile);
+        const auto field = json.find("\"" + std::string{key} + "\": ", profile);
+        if (field == std::string::npos || field > end) return -1;
+        return std::stod(json.substr(field + key.size() + 4));
+    }
+
+    bool compare(const std::string& baseline, const std::vector<result>& results)
+    {
+        auto regressed = false;
+        const auto check = [&](const result& result, const std::string_view key, const double value) {
+            const auto expected = find_value(baseline, result.name, key);
+            if (expected < 0) {
+                std::cerr << result.name << " " << key << ": not in baseline\n";
+                return;
+            }
+            const auto status = value > expected + tolerance ? "REGRESSION" : (value < expected - tolerance ? "improved" : "ok");
+            std::fprintf(stderr, "%-22s %-27s %10.2f %10.2f  %s\n", result.name, key.data(), expected, value, status);
+            regressed |= value > expected + tolerance;
+        };
+        std::fprintf(stderr, "%-22s %-27s %10s %10s\n", "profile", "metric", "baseline", "current");
+        for (const auto& result : results) {
+            check(result, "bytes_per_move", result.bytes_per_move());
+            check(result, "bytes_per_level_init", result.bytes_per_level_init());
+        }
+        return !regressed;
+    }
+
+}  // namespace
+
+int main(const int argc, const char* argv[])
+{
+    auto json_path = std::string{};
+    auto baseline_path = std::string{};
+    auto verify = false;
+    for (auto i = 1; i < argc; i++) {
+        const auto arg = std::string{argv[i]};
+        if (arg == "--json" && i + 1 < argc)
+            json_path = argv[++i];
+        else if (arg == "--compare" && i + 1 < argc)
+            baseline_path = argv[++i];
+        else if (arg == "--verify")
+            verify = true;
+        else {
+            std::cerr << "Usage: vtnibbler_bench [--json FILE] [--compare BASELINE] [--verify]\n";
+            return 2;
+        }
+    }
+
+    auto results = std::vector<result>{};
+    for (const auto& profile : profiles)
+        results.push_back(run_profile(profile, verify));
+
+    if (json_path.empty())
+        write_json(std::cout, results);
+    else {
+        auto file = std::ofstream{json_path};
+        write_json(file, results);
+    }
+
+    report_rep_savings(results);
+
+    if (!baseline_path.empty()) {
+        auto file = std::ifstream{baseline_path};
+        if (!file) {
+            std::cerr << "vtnibbler_bench: unable to read baseline '" << baseline_path << "'\n";
+            return 2;
+        }
+        const auto baseline = std::string{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+        if (!compare(baseline, results)) return 1;
+    }
+    if (verify && !compare_encoders(results)) return 1;
+    return 0;
+}
@@ -0,0 +1,43 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include "sink.h"
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// A sink that counts what would have been sent to the terminal, and passes
+// it on to another sink if there is one.
+class counting_sink : public render_sink {
+public:
+    explicit counting_sink(render_sink* target = nullptr)
+        : _target{target}
+    {
+    }
+
+    void write(const std::string_view data) override
+    {
+        bytes += data.size();
+        if (_target) _target->write(data);
+    }
+
+    void sync(const std::string_view request) override
+    {
+        bytes += request.size();
+        if (_target) _target->sync(request);
+    }
+
+    std::optional<checksum_report> poll_checksum() override
+    {
+        return _target ? _target->poll_checksum() : std::nullopt;
+    }
+
+    uint64_t bytes = 0;
+
+private:
+    render_sink* _target;
+};
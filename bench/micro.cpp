@@ -0,0 +1,271 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+// Measures the encoding primitives that run many times per frame on their
+// own: cursor movement, SGR transitions, number formatting, macro encoding,
+// and the status line number format. Each reports the time and the bytes
+// it takes per operation, as JSON.
+
+#include "counting_sink.h"
+
+#include "allocations.h"
+#include "capabilities.h"
+#include "options.h"
+#include "screen.h"
+#include "status.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    constexpr auto ops_per_run = 100000;
+    constexpr auto runs = 5;
+
+    struct measurement {
+        std::string name;
+        double ns_per_op;
+        double bytes_per_op;
+        double allocations_per_op;
+    };
+
+    struct profile {
+        const char* name;
+        bool color;
+        bool eight_bit;
+    };
+
+    constexpr auto profiles = std::to_array<profile>({
+        {"mono-7bit", false, false},
+        {"mono-8bit", false, true},
+        {"color-7bit", true, false},
+        {"color-8bit", true, true},
+    });
+
+    // A screen with macros enabled, so the same setup can be used for every
+    // primitive. Nothing here waits for a reply, so the sink never answers.
+    class bench_screen {
+    public:
+        explicit bench_screen(const profile& profile)
+        {
+            _caps.has_soft_fonts = true;
+            _caps.has_color = profile.color;
+            _caps.has_8bit = profile.eight_bit;
+            _caps.has_macros = true;
+            _caps.has_rectangle_ops = true;
+            _caps.terminal_id = 65;
+            _options.color = profile.color;
+            screen = screen::create(_caps, _options, sink);
+            screen->flush();
+        }
+
+        counting_sink sink;
+        std::unique_ptr<::screen> screen;
+
+    private:
+        capabilities _caps{capabilities::headless};
+        options _options;
+    };
+
+    // We take the fastest of several runs, since anything slower than that
+    // is just noise from the rest of the system. The screen buffer is only
+    // 512 bytes, so it's flushed after every few operations.
+    template <typename T>
+    measurement measure(const std::string& name, counting_sink& sink, screen* screen, const int flush_every, T&& op)
+    {
+        auto best = std::numeric_limits<double>::max();
+        auto bytes = uint64_t{0};
+        auto allocations = size_t{0};
+        for (auto run = 0; run < runs; run++) {
+            sink.bytes = 0;
+            const auto start_allocations = allocation_counter::count();
+            const auto start_time = std::chrono::steady_clock::now();
+            for (auto i = 0; i < ops_per_run; i++) {
+                op(i);
+                if (screen && i % flush_every == flush_every - 1) screen->flush();
+            }
+            if (screen) screen->flush();
+            const auto elapsed = std::chrono::steady_clock::now() - start_time;
+            best = std::min(best, double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+            bytes = sink.bytes;
+            allocations = allocation_counter::count() - start_allocations;
+        }
+        return {name, best / ops_per_run, double(bytes) / ops_per_run, double(allocations) / ops_per_run};
+    }
+
+    void cursor_benchmarks(std::vector<measurement>& results)
+    {
+        // Each delta is measured as a round trip between two points, so half
+        // the moves are in one direction and half in the other. The largest
+        // deltas end up as absolute positions.
+        static constexpr auto y_deltas = std::to_array({0, 1, 2, 5, 20});
+        static constexpr auto x_deltas = std::to_array({0, 1, 2, 5, 37});
+        // The color doesn't affect the cursor movement, so we only need the
+        // monochrome profiles here.
+        for (const auto& profile : profiles) {
+            if (profile.color) continue;
+            auto bench = bench_screen{profile};
+            for (const auto dy : y_deltas) {
+                for (const auto dx : x_deltas) {
+                    if (dy == 0 && dx == 0) continue;
+                    const auto name = std::string{"cup "} + (profile.eight_bit ? "8bit" : "7bit") + " dy=" + std::to_string(dy) + " dx=" + std::to_string(dx);
+                    auto& screen = *bench.screen;
+                    screen.move_cursor(1, 1);
+                    results.push_back(measure(name, bench.sink, &screen, 32, [&](const int i) {
+                        if (i & 1)
+                            screen.move_cursor(1, 1);
+                        else
+                            screen.move_cursor(1 + dy, 1 + dx);
+                    }));
+                }
+            }
+        }
+    }
+
+    void sgr_benchmarks(std::vector<measurement>& results)
+    {
+        // Stepping through every ordered pair of colors covers each possible
+        // transition, including the ones that are no change at all.
+        static constexpr auto colors = std::to_array({
+            color::red,
+            color::text,
+            color::yellow,
+            color::blue,
+            color::time,
+            color::cyan,
+            color::white,
+            color::crouton_1,
+            color::crouton_2,
+            color::wall,
+        });
+        for (const auto& profile : profiles) {
+            auto bench = bench_screen{profile};
+            auto& screen = *bench.screen;
+            const auto name = std::string{"sgr "} + profile.name + " all pairs";
+            results.push_back(measure(name, bench.sink, &screen, 32, [&](const int i) {
+                const auto pair = (i / 2) % (colors.size() * colors.size());
+                screen.set_color(colors[i & 1 ? pair % colors.size() : pair / colors.size()]);
+            }));
+        }
+    }
+
+    void number_benchmarks(std::vector<measurement>& results)
+    {
+        static constexpr auto ranges = std::to_array<std::pair<int, int>>({{0, 10}, {10, 100}, {100, 1000}, {1000, 10000}});
+        auto bench = bench_screen{profiles[0]};
+        auto& screen = *bench.screen;
+        for (auto digits = 1; const auto [low, high] : ranges) {
+            const auto name = "write_number " + std::to_string(digits++) + " digits";
+            results.push_back(measure(name, bench.sink, &screen, 64, [&](const int i) {
+                screen.write_number(low + i % (high - low));
+            }));
+        }
+    }
+
+    void macro_benchmarks(std::vector<measurement>& results)
+    {
+        // The macro content is drawn the same way as the game draws it, so
+        // each size includes a cursor move and a color change.
+        static constexpr auto sizes = std::to_array({8, 32, 128});
+        for (const auto& profile : profiles) {
+            if (profile.color) continue;
+            auto bench = bench_screen{profile};
+            auto& screen = *bench.screen;
+            for (const auto size : sizes) {
+                const auto content = std::string(size, 'X');
+                const auto name = std::string{"define_macro "} + (profile.eight_bit ? "8bit" : "7bit") + " " + std::to_string(size) + " chars";
+                results.push_back(measure(name, bench.sink, &screen, 1, [&](const int i) {
+                    screen.define_macro(i % 64, [&] {
+                        screen.write(1 + i % 2, 1, content, i & 1 ? color::wall : color::red);
+                    });
+                }));
+            }
+        }
+    }
+
+    void status_benchmarks(std::vector<measurement>& results)
+    {
+        // There's no screen involved here, so the bytes are just the length
+        // of the formatted string.
+        static constexpr auto scales = std::to_array({100, 100000, 100000000});
+        auto sink = counting_sink{};
+        for (const auto scale : scales) {
+            const auto name = "format_number below " + std::to_string(scale);
+            results.push_back(measure(name, sink, nullptr, 1, [&](const int i) {
+                sink.bytes += status::format_number((i * 7919) % scale).length;
+            }));
+        }
+    }
+
+    void write_json(std::ostream& out, const std::vector<measurement>& results)
+    {
+#ifdef NDEBUG
+        constexpr auto allocations_counted = false;
+#else
+        constexpr auto allocations_counted = true;
+#endif
+        out << "{\n";
+        out << "  \"ops_per_run\": " << ops_per_run << ",\n";
+        out << "  \"allocations_counted\": " << (allocations_counted ? "true" : "false") << ",\n";
+        out << "  \"benchmarks\": [\n";
+        for (auto i = size_t{0}; i < results.size(); i++) {
+            const auto& result = results[i];
+            char line[256];
+            std::snprintf(line, sizeof(line),
+                          "    {\"name\": \"%s\", \"ns_per_op\": %.2f, \"bytes_per_op\": %.2f, \"allocations_per_op\": %.2f}%s\n",
+                          result.name.c_str(), result.ns_per_op, result.bytes_per_op, result.allocations_per_op,
+                          i + 1 < results.size() ? "," : "");
+            out << line;
+        }
+        out << "  ]\n";
+        out << "}\n";
+    }
+
+}  // namespace
+
+int main(const int argc, const char* argv[])
+{
+    auto json_path = std::string{};
+    auto filter = std::string{};
+    for (auto i = 1; i < argc; i++) {
+        const auto arg = std::string{argv[i]};
+        if (arg == "--json" && i + 1 < argc)
+            json_path = argv[++i];
+        else if (arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else {
+            std::cerr << "Usage: vtnibbler_microbench [--json FILE] [--filter GROUP]\n";
+            return 2;
+        }
+    }
+
+    auto results = std::vector<measurement>{};
+    const auto selected = [&](const std::string_view group) {
+        return filter.empty() || filter == group;
+    };
+    if (selected("cup")) cursor_benchmarks(results);
+    if (selected("sgr")) sgr_benchmarks(results);
+    if (selected("write_number")) number_benchmarks(results);
+    if (selected("define_macro")) macro_benchmarks(results);
+    if (selected("format_number")) status_benchmarks(results);
+
+    if (json_path.empty())
+        write_json(std::cout, results);
+    else {
+        auto file = std::ofstream{json_path};
+        write_json(file, results);
+    }
+    return 0;
+}
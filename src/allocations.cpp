@@ -0,0 +1,48 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#include "allocations.h"
+
+#ifndef NDEBUG
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+    thread_local auto allocation_count = std::size_t{0};
+
+}  // namespace
+
+void* operator new(const std::size_t size)
+{
+    allocation_count++;
+    if (const auto memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* const memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* const memory, const std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+std::size_t allocation_counter::count()
+{
+    return allocation_count;
+}
+
+#else
+
+std::size_t allocation_counter::count()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,15 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include <cstddef>
+
+// In debug builds we count every heap allocation made by the current thread,
+// so we can check that the steady-state game loop never allocates. In
+// release builds the count is always zero.
+class allocation_counter {
+public:
+    static std::size_t count();
+};
@@ -0,0 +1,93 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#include "animation.h"
+
+#include <utility>
+
+animation::animation(const handle coroutine)
+    : _coroutine{coroutine}
+{
+}
+
+animation::animation(animation&& other) noexcept
+    : _coroutine{std::exchange(other._coroutine, {})}
+{
+}
+
+animation& animation::operator=(animation&& other) noexcept
+{
+    if (this != &other) {
+        if (_coroutine) _coroutine.destroy();
+        _coroutine = std::exchange(other._coroutine, {});
+    }
+    return *this;
+}
+
+animation::~animation()
+{
+    if (_coroutine) _coroutine.destroy();
+}
+
+bool animation::done() const
+{
+    return !_coroutine || _coroutine.done();
+}
+
+animation::duration animation::resume()
+{
+    // When an animation is awaiting another, it's the innermost one that
+    // needs to be resumed. Whichever it is, the delay it yields is recorded
+    // in the root promise.
+    auto& promise = _coroutine.promise();
+    promise.delay = {};
+    promise.active.resume();
+    return promise.delay;
+}
+
+animation::awaiter animation::operator co_await() && noexcept
+{
+    return {_coroutine};
+}
+
+std::coroutine_handle<> animation::awaiter::await_suspend(handle parent) noexcept
+{
+    auto& promise = child.promise();
+    promise.root = parent.promise().root;
+    promise.continuation = parent;
+    promise.root->active = child;
+    return child;
+}
+
+std::coroutine_handle<> animation::final_awaiter::await_suspend(handle coroutine) noexcept
+{
+    // Once an awaited animation completes, control passes straight back to
+    // the one that was waiting for it.
+    auto& promise = coroutine.promise();
+    if (promise.continuation) {
+        promise.root->active = promise.continuation;
+        return promise.continuation;
+    }
+    return std::noop_coroutine();
+}
+
+animation interleave(animation first, animation second)
+{
+    // Both animations are stepped independently, tracking when each is next
+    // due relative to the time we started, and we yield for however long it
+    // is until the earliest of them is ready to run again.
+    auto first_due = animation::duration{};
+    auto second_due = animation::duration{};
+    auto elapsed = animation::duration{};
+    while (!first.done() || !second.done()) {
+        const auto run_first = !first.done() && (second.done() || first_due <= second_due);
+        auto& next = run_first ? first : second;
+        auto& due = run_first ? first_due : second_due;
+        if (due > elapsed) {
+            co_yield due - elapsed;
+            elapsed = due;
+        }
+        due += next.resume();
+    }
+}
@@ -0,0 +1,64 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+
+class animation {
+public:
+    using duration = std::chrono::steady_clock::duration;
+
+    struct promise_type;
+    using handle = std::coroutine_handle<promise_type>;
+
+    struct final_awaiter {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(handle coroutine) noexcept;
+        void await_resume() noexcept {}
+    };
+
+    struct promise_type {
+        duration delay = {};
+        promise_type* root = this;
+        handle active = handle::from_promise(*this);
+        handle continuation = {};
+
+        animation get_return_object() { return animation{handle::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        final_awaiter final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() { std::terminate(); }
+
+        std::suspend_always yield_value(const duration delay) noexcept
+        {
+            root->delay = delay;
+            return {};
+        }
+    };
+
+    struct awaiter {
+        handle child;
+
+        bool await_ready() noexcept { return !child || child.done(); }
+        std::coroutine_handle<> await_suspend(handle parent) noexcept;
+        void await_resume() noexcept {}
+    };
+
+    animation(animation&& other) noexcept;
+    animation& operator=(animation&& other) noexcept;
+    ~animation();
+    bool done() const;
+    duration resume();
+    awaiter operator co_await() && noexcept;
+
+private:
+    explicit animation(const handle coroutine);
+
+    handle _coroutine;
+};
+
+animation interleave(animation first, animation second);
@@ -0,0 +1,53 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// A grid of bits, packed one row per word, which keeps the grids small
+// enough that copying and clearing them is just a handful of word ops.
+template <int Width, int Height>
+class bitboard {
+public:
+    static_assert(Width <= 32, "rows must fit in a 32-bit word");
+    using row_type = uint32_t;
+
+    constexpr bool test(const int y, const int x) const
+    {
+        return (_rows[y] >> x) & 1;
+    }
+
+    constexpr void set(const int y, const int x, const bool value = true)
+    {
+        const auto bit = row_type{1} << x;
+        _rows[y] = value ? (_rows[y] | bit) : (_rows[y] & ~bit);
+    }
+
+    constexpr void reset(const int y, const int x)
+    {
+        _rows[y] &= ~(row_type{1} << x);
+    }
+
+    constexpr void reset()
+    {
+        _rows = {};
+    }
+
+    constexpr row_type row(const int y) const
+    {
+        return _rows[y];
+    }
+
+    constexpr bool any() const
+    {
+        for (auto row : _rows)
+            if (row) return true;
+        return false;
+    }
+
+private:
+    std::array<row_type, Height> _rows = {};
+};
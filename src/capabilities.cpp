@@ -5,6 +5,7 @@
 #include "capabilities.h"
 
 #include "os.h"
+#include "sequences.h"
 
 #include <cstring>
 #include <iostream>
@@ -27,6 +28,12 @@ capabilities::capabilities()
     // Check if 8-bit controls are supported.
     std::cout << "\0338\2335n\033[1K";
     has_8bit = !_query(R"(\x1B\[\d*n)", true).empty();
+    // Check if REP is supported, by repeating a character at the start of the
+    // line, and seeing where the cursor ends up.
+    std::cout << "\0338\r \033[2b\033[6n";
+    const auto rep_position = _query(R"(\x1B\[(\d+);(\d+)R)", false);
+    has_rep = !rep_position.empty() && std::stoi(rep_position[2]) == 4;
+    std::cout << "\033[1K";
     // Retrieve the device attributes report.
     _query_device_attributes();
     // Retrieve the terminal id so we can guess the font size.
@@ -37,7 +44,7 @@ capabilities::capabilities()
 
 std::optional<bool> capabilities::query_mode(const int mode) const
 {
-    std::cout << "\033[?" << mode << "$p";
+    std::cout << make_sequence("\033[?", mode, "$p").view(false);
     const auto report = _query(R"(\x1B\[\?(\d+);(\d+)\$y)", true);
     if (!report.empty()) {
         const auto returned_mode = std::stoi(report[1]);
@@ -52,7 +59,7 @@ std::optional<bool> capabilities::query_mode(const int mode) const
 
 std::string capabilities::query_setting(const std::string_view setting) const
 {
-    std::cout << "\033P$q" << setting << "\033\\";
+    std::cout << make_sequence("\033P$q", setting, "\033\\").view(false);
     const auto report = _query(R"(\x1BP1\$r(.*)\x1B\\)", true);
     if (!report.empty())
         return report[1];
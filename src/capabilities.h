@@ -11,7 +11,15 @@
 
 class capabilities {
 public:
+    struct headless_t {};
+    static constexpr auto headless = headless_t{};
+
     capabilities();
+    // Creates a set of capabilities without querying the terminal, so the
+    // game can be run headless with whatever features are filled in.
+    explicit capabilities(const headless_t)
+    {
+    }
     std::optional<bool> query_mode(const int mode) const;
     std::string query_setting(const std::string_view setting) const;
     std::string query_color_table() const;
@@ -23,6 +31,7 @@ public:
     bool has_rectangle_ops = false;
     bool has_macros = false;
     bool has_8bit = false;
+    bool has_rep = false;
     int terminal_id = 0;
 
 private:
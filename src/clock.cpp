@@ -0,0 +1,56 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#include "clock.h"
+
+#include "options.h"
+#include "os.h"
+
+#include <algorithm>
+
+game_clock::game_clock(const options& options)
+    : _scale{options.timescale}, _epoch{std::chrono::steady_clock::now()},
+      _virtual_time{_epoch}
+{
+}
+
+bool game_clock::is_virtual() const
+{
+    return _scale == 0;
+}
+
+game_clock::time_point game_clock::now() const
+{
+    // A scale of zero means we're running on virtual time, which only ever
+    // advances when we sleep. Otherwise the real time is sped up by the scale
+    // factor, which will be 1 for normal play.
+    if (is_virtual())
+        return _virtual_time;
+    const auto elapsed = std::chrono::steady_clock::now() - _epoch;
+    return _epoch + elapsed * _scale;
+}
+
+void game_clock::sleep_for(const duration duration)
+{
+    sleep_until(now() + duration);
+}
+
+game_clock::duration game_clock::sleep_until(const time_point time, const duration spin_time)
+{
+    if (is_virtual()) {
+        _virtual_time = std::max(_virtual_time, time);
+        return {};
+    }
+    const auto real_time = _epoch + (time - _epoch) / _scale;
+    const auto wake_time = real_time - spin_time;
+    const auto slept = std::chrono::steady_clock::now() < wake_time;
+    os::sleep_until(wake_time);
+    const auto woken = std::chrono::steady_clock::now();
+    // If requested, we spin for the last few microseconds, since the OS
+    // sleep is likely to oversleep by at least that much.
+    while (std::chrono::steady_clock::now() < real_time) {
+    }
+    // We return how late the OS woke us, so the caller can size the spin.
+    return slept ? std::max(woken - wake_time, duration{}) : duration{};
+}
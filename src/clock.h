@@ -0,0 +1,26 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include <chrono>
+
+class options;
+
+class game_clock {
+public:
+    using duration = std::chrono::steady_clock::duration;
+    using time_point = std::chrono::steady_clock::time_point;
+
+    game_clock(const options& options);
+    bool is_virtual() const;
+    time_point now() const;
+    void sleep_for(const duration duration);
+    duration sleep_until(const time_point time, const duration spin_time = {});
+
+private:
+    const int _scale;
+    const time_point _epoch;
+    time_point _virtual_time;
+};
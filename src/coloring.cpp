@@ -6,9 +6,19 @@
 
 #include "capabilities.h"
 #include "options.h"
+#include "sequences.h"
 
 #include <iostream>
 
+namespace {
+
+    constexpr auto fixed_color_table = make_sequence<96>(
+        "\033P2$p",
+        "0;2;0;0;0/1;2;100;0;0/3;2;100;100;0/4;2;0;0;87/6;2;0;72;59/7;2;100;100;87",
+        "\033\\");
+
+}  // namespace
+
 coloring::coloring(const capabilities& caps, const options& options)
     : _using_colors{options.color && caps.has_color}
 {
@@ -20,7 +30,7 @@ coloring::coloring(const capabilities& caps, const options& options)
         // Save the current color table.
         _color_table = caps.query_color_table();
         // Set the fixed color table entries.
-        std::cout << "\033P2$p0;2;0;0;0/1;2;100;0;0/3;2;100;100;0/4;2;0;0;87/6;2;0;72;59/7;2;100;100;87\033\\";
+        std::cout << fixed_color_table.view(caps.has_8bit);
     }
 }
 
@@ -0,0 +1,595 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#include "emulator.h"
+
+#include "game.h"
+#include "screen.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+
+namespace {
+
+    constexpr auto max_macro_depth = 8;
+
+    int hex_value(const char ch)
+    {
+        if (ch >= '0' && ch <= '9') return ch - '0';
+        if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+        if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+        return -1;
+    }
+
+}  // namespace
+
+vt_emulator::vt_emulator(const int height, const int width)
+    : _height{height}, _width{width}
+{
+    _cells.resize(height * width);
+    _intermediates.reserve(8);
+    _data.reserve(4096);
+}
+
+void vt_emulator::answer_queries(const terminal_identity& identity)
+{
+    _identity = &identity;
+}
+
+std::string vt_emulator::take_replies()
+{
+    return std::exchange(_replies, {});
+}
+
+void vt_emulator::write(const std::string_view data)
+{
+    _bytes += data.size();
+    for (const auto ch : data)
+        _feed(ch);
+}
+
+void vt_emulator::sync(const std::string_view request)
+{
+    // Everything is processed as soon as it's written, so the terminal has
+    // always caught up by the time the request arrives.
+    write(request);
+}
+
+void vt_emulator::probe(const std::string_view request)
+{
+    write(request);
+}
+
+std::optional<checksum_report> vt_emulator::poll_checksum()
+{
+    return std::exchange(_checksum, std::nullopt);
+}
+
+int vt_emulator::height() const
+{
+    return _height;
+}
+
+int vt_emulator::width() const
+{
+    return _width;
+}
+
+const emulated_cell& vt_emulator::cell(const int y, const int x) const
+{
+    return _cells[(y - 1) * _width + (x - 1)];
+}
+
+const std::vector<emulated_cell>& vt_emulator::cells() const
+{
+    return _cells;
+}
+
+int vt_emulator::cursor_y() const
+{
+    return _y;
+}
+
+int vt_emulator::cursor_x() const
+{
+    return _x;
+}
+
+const std::string& vt_emulator::soft_font() const
+{
+    return _soft_font;
+}
+
+std::string_view vt_emulator::palette(const int index) const
+{
+    return _palette[index];
+}
+
+uint64_t vt_emulator::bytes() const
+{
+    return _bytes;
+}
+
+int vt_emulator::mismatches(const screen_snapshot& snapshot) const
+{
+    // Cells the model has never drawn must still be blank, but for the rest
+    // we compare the character, its attributes, and which character set it
+    // came from. The model's colors are game colors rather than renditions,
+    // so they're left to the comparisons between emulators.
+    auto count = 0;
+    for (auto y = 1; y <= game::height; y++) {
+        for (auto x = 1; x <= game::width; x++) {
+            const auto& expected = snapshot.cells[(y - 1) * game::width + (x - 1)];
+            const auto& actual = cell(y + snapshot.top, x + snapshot.left);
+            if (expected.ch != actual.ch)
+                count++;
+            else if (expected.ch && (expected.attributes != actual.attributes || expected.ascii != actual.ascii))
+                count++;
+        }
+    }
+    const auto cursor_known = snapshot.cursor_y != -1 && snapshot.cursor_x != -1;
+    if (cursor_known && (snapshot.cursor_y != _y || std::min(snapshot.cursor_x, _width) != _x))
+        count++;
+    return count;
+}
+
+void vt_emulator::_feed(const char ch)
+{
+    const auto c = static_cast<unsigned char>(ch);
+    switch (_state) {
+        case state::ground:
+            // A terminal that doesn't accept C1 controls just ignores them.
+            if (c >= 0x80 && c <= 0x9F && _identity && !_identity->accepts_c1) break;
+            if (c == 0x1B) {
+                _intermediates.clear();
+                _state = state::escape;
+            } else if (c == 0x9B || c == 0x90)
+                _start_sequence(c == 0x9B ? state::csi : state::dcs);
+            else if (c == 0x8D)
+                _y = std::max(_y - 1, 1);
+            else if (c == 0x98 || c == 0x9D || c == 0x9E || c == 0x9F)
+                _state = state::ignored_string;
+            else if (c == '\b')
+                _x = std::max(_x - 1, 1);
+            else if (c == '\n' || c == '\v' || c == '\f')
+                _y = std::min(_y + 1, _height);
+            else if (c == '\r')
+                _x = 1;
+            else if ((c >= 0x20 && c < 0x7F) || c >= 0xA0)
+                _print(ch);
+            break;
+        case state::escape:
+            if (c == '[' || c == 'P')
+                _start_sequence(c == '[' ? state::csi : state::dcs);
+            else if (c == ']' || c == 'X' || c == '^' || c == '_')
+                _state = state::ignored_string;
+            else if (c >= 0x20 && c <= 0x2F) {
+                _intermediates += ch;
+                _state = state::escape_intermediate;
+            } else {
+                _state = state::ground;
+                _escape_dispatch(ch);
+            }
+            break;
+        case state::escape_intermediate:
+            if (c >= 0x20 && c <= 0x2F)
+                _intermediates += ch;
+            else {
+                _state = state::ground;
+                _escape_dispatch(ch);
+            }
+            break;
+        case state::csi:
+        case state::dcs:
+            if (c >= '0' && c <= '9') {
+                _parameter_count = std::max(_parameter_count, 1);
+                auto& parameter = _parameters[_parameter_count - 1];
+                parameter = std::min(parameter * 10 + (c - '0'), 99999);
+            } else if (c == ';') {
+                _parameter_count = std::min(std::max(_parameter_count, 1) + 1, int(_parameters.size()));
+            } else if (c >= '<' && c <= '?')
+                _private = ch;
+            else if (c >= 0x20 && c <= 0x2F)
+                _intermediates += ch;
+            else if (c >= 0x40 && c <= 0x7E) {
+                _final = ch;
+                if (_state == state::csi) {
+                    _state = state::ground;
+                    _csi_dispatch(ch);
+                } else {
+                    _data.clear();
+                    _state = state::dcs_data;
+                }
+            }
+            break;
+        case state::dcs_data:
+            if (c == 0x9C) {
+                _state = state::ground;
+                _dcs_dispatch();
+            } else if (c == 0x1B)
+                _state = state::dcs_escape;
+            else
+                _data += ch;
+            break;
+        case state::dcs_escape:
+            // Any escape sequence ends the string, but only ST is consumed.
+            _state = state::ground;
+            _dcs_dispatch();
+            if (c != '\\') {
+                _feed('\x1B');
+                _feed(ch);
+            }
+            break;
+        case state::ignored_string:
+            if (c == 0x9C || c == 0x07)
+                _state = state::ground;
+            else if (c == 0x1B)
+                _state = state::ignored_escape;
+            break;
+        case state::ignored_escape:
+            _state = state::ground;
+            break;
+    }
+}
+
+void vt_emulator::_start_sequence(const state next)
+{
+    _parameters.fill(0);
+    _parameter_count = 0;
+    _private = 0;
+    _intermediates.clear();
+    _state = next;
+}
+
+void vt_emulator::_escape_dispatch(const char final)
+{
+    if (_intermediates.empty()) {
+        if (final == '7') {
+            _saved_y = _y;
+            _saved_x = _x;
+            _saved_rendition = _rendition;
+        } else if (final == '8') {
+            _y = _saved_y;
+            _x = _saved_x;
+            _rendition = _saved_rendition;
+        } else if (final == 'M')
+            _y = std::max(_y - 1, 1);
+        else if (final == 'D')
+            _y = std::min(_y + 1, _height);
+        else if (final == 'E') {
+            _y = std::min(_y + 1, _height);
+            _x = 1;
+        }
+    } else if (_intermediates[0] == '(') {
+        // We only ever designate into G0, which is always mapped to GL.
+        _designation = _intermediates.substr(1) + final;
+        _rendition.ascii = _designation == "B";
+    }
+}
+
+void vt_emulator::_csi_dispatch(const char final)
+{
+    if (_private) {
+        _private_dispatch(final);
+        return;
+    }
+    if (_intermediates.empty()) {
+        switch (final) {
+            case 'H':
+            case 'f':
+                _y = std::min(_parameter(0, 1), _height);
+                _x = std::min(_parameter(1, 1), _width);
+                break;
+            case 'A':
+                _y = std::max(_y - _parameter(0, 1), 1);
+                break;
+            case 'B':
+                _y = std::min(_y + _parameter(0, 1), _height);
+                break;
+            case 'C':
+                _x = std::min(_x + _parameter(0, 1), _width);
+                break;
+            case 'D':
+                _x = std::max(_x - _parameter(0, 1), 1);
+                break;
+            case 'J':
+                if (_parameter(0, 0) == 0) {
+                    _erase(_y, _x, _y, _width);
+                    _erase(_y + 1, 1, _height, _width);
+                } else if (_parameter(0, 0) == 1) {
+                    _erase(1, 1, _y - 1, _width);
+                    _erase(_y, 1, _y, _x);
+                } else if (_parameter(0, 0) == 2)
+                    _erase(1, 1, _height, _width);
+                break;
+            case 'K':
+                if (_parameter(0, 0) == 0)
+                    _erase(_y, _x, _y, _width);
+                else if (_parameter(0, 0) == 1)
+                    _erase(_y, 1, _y, _x);
+                else if (_parameter(0, 0) == 2)
+                    _erase(_y, 1, _y, _width);
+                break;
+            case 'X':
+                _erase(_y, _x, _y, std::min(_x + _parameter(0, 1) - 1, _width));
+                break;
+            case 'b':
+                if (_last_printed && (!_identity || _identity->has_rep)) {
+                    const auto count = _parameter(0, 1);
+                    for (auto i = 0; i < count; i++)
+                        _print(*_last_printed);
+                }
+                break;
+            case 'm':
+                for (auto i = 0; i < std::max(_parameter_count, 1); i++) {
+                    const auto value = _parameters[i];
+                    if (value == 0)
+                        _rendition = {0, 0, 7, _rendition.ascii};
+                    else if (value == 1)
+                        _rendition.attributes |= 0x80;
+                    else if (value == 5)
+                        _rendition.attributes |= 0x40;
+                    else if (value == 22)
+                        _rendition.attributes &= ~0x80;
+                    else if (value == 25)
+                        _rendition.attributes &= ~0x40;
+                    else if (value >= 30 && value <= 37)
+                        _rendition.foreground = value - 30;
+                    else if (value == 39)
+                        _rendition.foreground = 7;
+                }
+                break;
+            case 'c':
+                if (_identity && _parameter(0, 0) == 0) _reply(_identity->primary_attributes);
+                break;
+            case 'n':
+                if (_parameter(0, 0) == 5)
+                    _reply("\033[0n");
+                else if (_parameter(0, 0) == 6) {
+                    char report[16];
+                    std::snprintf(report, sizeof(report), "\033[%d;%dR", _y, _x);
+                    _reply(report);
+                }
+                break;
+        }
+    } else if (_intermediates == "$" && final == 'u') {
+        // DECRQTSR for the color table, which is reported in the same form
+        // as DECCTR uses to set it.
+        if (_identity && _identity->has_color_table && _parameter(0, 0) == 2) {
+            auto report = std::string{"\033P2$s"};
+            for (auto i = 0; i < int(_palette.size()); i++) {
+                if (_palette[i].empty()) continue;
+                if (report.back() != 's') report += '/';
+                report += std::to_string(i) + ';' + _palette[i];
+            }
+            _reply(report + "\033\\");
+        }
+    } else if (_intermediates == "$") {
+        switch (final) {
+            case 'r':
+                _change_attributes(_parameter(0, 1), _parameter(1, 1), _parameter(2, _height), _parameter(3, _width));
+                break;
+            case 'z':
+                _erase(_parameter(0, 1), _parameter(1, 1), _parameter(2, _height), _parameter(3, _width));
+                break;
+            case 'x': {
+                const auto ch = static_cast<char>(_parameter(0, ' '));
+                const auto bottom = std::min(_parameter(3, _height), _height);
+                const auto right = std::min(_parameter(4, _width), _width);
+                for (auto y = _parameter(1, 1); y <= bottom; y++) {
+                    for (auto x = _parameter(2, 1); x <= right; x++)
+                        *_cell(y, x) = {ch, _rendition.attributes, _rendition.foreground, _rendition.ascii};
+                }
+                break;
+            }
+            case 'v':
+                _copy_area();
+                break;
+        }
+    } else if (_intermediates == "*") {
+        if (final == 'y')
+            _report_checksum();
+        else if (final == 'z')
+            _invoke_macro(_parameter(0, 0));
+    }
+}
+
+void vt_emulator::_private_dispatch(const char final)
+{
+    if (!_identity) return;
+    if (_private == '>' && final == 'c' && _intermediates.empty())
+        _reply(_identity->secondary_attributes);
+    else if (_private == '=' && final == 'c' && _intermediates.empty())
+        _reply(_identity->tertiary_attributes);
+    else if (_private == '?' && final == 'p' && _intermediates == "$") {
+        // We don't track any modes, so they're all reported as unknown.
+        char report[24];
+        std::snprintf(report, sizeof(report), "\033[?%d;0$y", _parameter(0, 0));
+        _reply(report);
+    }
+}
+
+void vt_emulator::_dcs_dispatch()
+{
+    if (_intermediates == "$" && _final == 'q')
+        _reply("\033P0$r\033\\");
+    else if (_intermediates == "!" && _final == 'z')
+        _define_macro();
+    else if (_intermediates == "$" && _final == 'p' && _parameter(0, 0) == 2)
+        _load_palette();
+    else if (_intermediates.empty() && _final == '{')
+        _load_font();
+}
+
+void vt_emulator::_reply(const std::string_view reply)
+{
+    if (_identity) _replies += reply;
+}
+
+void vt_emulator::_print(const char ch)
+{
+    // Autowrap is disabled, so once the cursor reaches the right margin,
+    // anything else written just overwrites the last column.
+    *_cell(_y, _x) = {ch, _rendition.attributes, _rendition.foreground, _rendition.ascii};
+    _last_printed = ch;
+    _x = std::min(_x + 1, _width);
+}
+
+int vt_emulator::_parameter(const int index, const int default_value) const
+{
+    // As on a real terminal, a parameter of zero is the same as omitting it.
+    const auto value = index < _parameter_count ? _parameters[index] : 0;
+    return value ? value : default_value;
+}
+
+emulated_cell* vt_emulator::_cell(const int y, const int x)
+{
+    return &_cells[(y - 1) * _width + (x - 1)];
+}
+
+void vt_emulator::_erase(const int top, const int left, const int bottom, const int right)
+{
+    for (auto y = std::max(top, 1); y <= std::min(bottom, _height); y++) {
+        for (auto x = std::max(left, 1); x <= std::min(right, _width); x++)
+            *_cell(y, x) = {};
+    }
+}
+
+void vt_emulator::_change_attributes(const int top, const int left, const int bottom, const int right)
+{
+    // DECCARA takes the same values as SGR, starting from the fifth
+    // parameter, and applies them to every cell in the area.
+    for (auto y = std::max(top, 1); y <= std::min(bottom, _height); y++) {
+        for (auto x = std::max(left, 1); x <= std::min(right, _width); x++) {
+            auto& cell = *_cell(y, x);
+            for (auto i = 4; i < std::max(_parameter_count, 5); i++) {
+                const auto value = i < _parameter_count ? _parameters[i] : 0;
+                if (value == 0)
+                    cell.attributes = 0;
+                else if (value == 1)
+                    cell.attributes |= 0x80;
+                else if (value == 5)
+                    cell.attributes |= 0x40;
+                else if (value == 22)
+                    cell.attributes &= ~0x80;
+                else if (value == 25)
+                    cell.attributes &= ~0x40;
+                else if (value >= 30 && value <= 37)
+                    cell.foreground = value - 30;
+                else if (value == 39)
+                    cell.foreground = 7;
+            }
+        }
+    }
+}
+
+void vt_emulator::_copy_area()
+{
+    // The source and destination may overlap, so the source is copied out
+    // before anything is written.
+    const auto top = std::max(_parameter(0, 1), 1);
+    const auto left = std::max(_parameter(1, 1), 1);
+    const auto bottom = std::min(_parameter(2, _height), _height);
+    const auto right = std::min(_parameter(3, _width), _width);
+    const auto dest_top = _parameter(5, 1);
+    const auto dest_left = _parameter(6, 1);
+    if (top > bottom || left > right) return;
+    auto area = std::vector<emulated_cell>{};
+    for (auto y = top; y <= bottom; y++) {
+        for (auto x = left; x <= right; x++)
+            area.push_back(*_cell(y, x));
+    }
+    const auto area_width = right - left + 1;
+    for (auto i = 0; i < int(area.size()); i++) {
+        const auto y = dest_top + i / area_width;
+        const auto x = dest_left + i % area_width;
+        if (y <= _height && x <= _width) *_cell(y, x) = area[i];
+    }
+}
+
+void vt_emulator::_report_checksum()
+{
+    // This matches the first variant the integrity checker tries: blank
+    // cells count as spaces, and the attribute bits are included.
+    const auto top = std::max(_parameter(2, 1), 1);
+    const auto left = std::max(_parameter(3, 1), 1);
+    const auto bottom = std::min(_parameter(4, _height), _height);
+    const auto right = std::min(_parameter(5, _width), _width);
+    auto total = 0;
+    for (auto y = top; y <= bottom; y++) {
+        for (auto x = left; x <= right; x++) {
+            const auto& cell = *_cell(y, x);
+            if (cell.ch == 0)
+                total += ' ';
+            else
+                total += static_cast<unsigned char>(cell.ch) + cell.attributes;
+        }
+    }
+    _checksum = checksum_report{_parameter(0, 0), -total & 0xFFFF};
+    char report[24];
+    std::snprintf(report, sizeof(report), "\033P%d!~%04X\033\\", _checksum->id, _checksum->checksum);
+    _reply(report);
+}
+
+void vt_emulator::_define_macro()
+{
+    const auto id = _parameter(0, 0);
+    if (_parameter(1, 0) == 1) {
+        for (auto& macro : _macros)
+            macro.clear();
+    }
+    if (id >= int(_macros.size())) return;
+    auto& macro = _macros[id];
+    macro.clear();
+    if (_parameter(2, 0) == 1) {
+        for (auto i = size_t{0}; i + 1 < _data.size(); i += 2) {
+            const auto high = hex_value(_data[i]);
+            const auto low = hex_value(_data[i + 1]);
+            if (high < 0 || low < 0) break;
+            macro += static_cast<char>(high * 16 + low);
+        }
+    } else
+        macro = _data;
+}
+
+void vt_emulator::_invoke_macro(const int id)
+{
+    if (id >= int(_macros.size()) || _macro_depth >= max_macro_depth) return;
+    _macro_depth++;
+    for (const auto ch : _macros[id])
+        _feed(ch);
+    _macro_depth--;
+}
+
+void vt_emulator::_load_palette()
+{
+    // Each entry is the color number, the color space, and the components,
+    // with the entries separated by slashes. We keep everything after the
+    // color number as is.
+    for (auto start = size_t{0}; start < _data.size();) {
+        auto end = _data.find('/', start);
+        if (end == std::string::npos) end = _data.size();
+        const auto entry = std::string_view{_data}.substr(start, end - start);
+        const auto separator = entry.find(';');
+        if (separator != std::string_view::npos) {
+            auto index = 0;
+            for (const auto ch : entry.substr(0, separator))
+                index = index * 10 + (ch - '0');
+            if (index >= 0 && index < int(_palette.size()))
+                _palette[index] = entry.substr(separator + 1);
+        }
+        start = end + 1;
+    }
+}
+
+void vt_emulator::_load_font()
+{
+    // The font data starts with the designation it'll be selected with, made
+    // up of any intermediates and a final character.
+    auto length = size_t{0};
+    while (length < _data.size() && _data[length] >= 0x20 && _data[length] <= 0x2F)
+        length++;
+    if (length < _data.size()) _soft_font = _data.substr(0, length + 1);
+}
@@ -0,0 +1,132 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include "sink.h"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct screen_snapshot;
+
+// One cell of the emulated display. A character of zero means the cell has
+// been erased. The attributes use the same bits as the screen model: 0x80 for
+// bold, 0x40 for blink. The foreground is an SGR color index, with the
+// default treated as white.
+struct emulated_cell {
+    char ch = 0;
+    uint8_t attributes = 0;
+    uint8_t foreground = 7;
+    bool ascii = true;
+
+    bool operator==(const emulated_cell&) const = default;
+};
+
+// How the emulator identifies itself when it's answering queries, along with
+// the optional features that change what the game decides to send.
+struct terminal_identity {
+    std::string_view name;
+    std::string_view primary_attributes;
+    std::string_view secondary_attributes;
+    std::string_view tertiary_attributes;
+    bool accepts_c1 = true;
+    bool has_rep = false;
+    bool has_color_table = false;
+};
+
+// A model of the subset of a VT terminal that we actually use, so the effect
+// of our output can be checked without a real terminal. It understands the
+// cursor movement controls, SGR, SCS, REP, the rectangular area operations,
+// and macros, and keeps track of the palette and soft font that were loaded.
+// As a sink, it answers every request immediately, so it can also stand in
+// for a terminal in headless runs. Given an identity, it will also answer the
+// queries that the capability detection sends, for anything that needs the
+// replies as text.
+class vt_emulator : public render_sink {
+public:
+    vt_emulator(const int height = 24, const int width = 80);
+    void answer_queries(const terminal_identity& identity);
+    std::string take_replies();
+
+    void write(const std::string_view data) override;
+    void sync(const std::string_view request) override;
+    void probe(const std::string_view request) override;
+    std::optional<checksum_report> poll_checksum() override;
+
+    int height() const;
+    int width() const;
+    const emulated_cell& cell(const int y, const int x) const;
+    const std::vector<emulated_cell>& cells() const;
+    int cursor_y() const;
+    int cursor_x() const;
+    const std::string& soft_font() const;
+    std::string_view palette(const int index) const;
+    uint64_t bytes() const;
+    int mismatches(const screen_snapshot& snapshot) const;
+
+private:
+    enum class state {
+        ground,
+        escape,
+        escape_intermediate,
+        csi,
+        dcs,
+        dcs_data,
+        dcs_escape,
+        ignored_string,
+        ignored_escape,
+    };
+
+    void _feed(const char ch);
+    void _start_sequence(const state next);
+    void _escape_dispatch(const char final);
+    void _csi_dispatch(const char final);
+    void _private_dispatch(const char final);
+    void _dcs_dispatch();
+    void _reply(const std::string_view reply);
+    void _print(const char ch);
+    int _parameter(const int index, const int default_value) const;
+    emulated_cell* _cell(const int y, const int x);
+    void _erase(const int top, const int left, const int bottom, const int right);
+    void _change_attributes(const int top, const int left, const int bottom, const int right);
+    void _copy_area();
+    void _report_checksum();
+    void _define_macro();
+    void _invoke_macro(const int id);
+    void _load_palette();
+    void _load_font();
+
+    const int _height;
+    const int _width;
+    std::vector<emulated_cell> _cells;
+    const terminal_identity* _identity = nullptr;
+    std::string _replies;
+    int _y = 1;
+    int _x = 1;
+    emulated_cell _rendition = {};
+    int _saved_y = 1;
+    int _saved_x = 1;
+    emulated_cell _saved_rendition = {};
+    std::optional<char> _last_printed;
+    std::string _designation = "B";
+    std::string _soft_font;
+    std::array<std::string, 16> _palette = {};
+    std::array<std::string, 64> _macros = {};
+    int _macro_depth = 0;
+    std::optional<checksum_report> _checksum;
+    uint64_t _bytes = 0;
+
+    state _state = state::ground;
+    std::array<int, 16> _parameters = {};
+    int _parameter_count = 0;
+    char _private = 0;
+    std::string _intermediates;
+    char _final = 0;
+    std::string _data;
+};
@@ -4,152 +4,82 @@
 
 #include "engine.h"
 
-#include "coloring.h"
-#include "font.h"
-#include "levels.h"
+#include "allocations.h"
+#include "game.h"
+#include "latency.h"
 #include "options.h"
-#include "screen.h"
-#include "snake.h"
-#include "status.h"
+#include "replay.h"
+#include "scheduler.h"
+#include "terminal.h"
+#include "trace.h"
 
-#include <chrono>
+#include <cassert>
 
-using namespace std::chrono_literals;
-
-engine::engine(const capabilities& caps, const options& options, soft_font& font)
-    : _caps{caps}, _options{options}, _font{font}
+engine::engine(const capabilities& caps, const options& options, soft_font& font, terminal& terminal, scheduler& scheduler,
+               latency_tracker& latency, replay_recorder* recorder, replay_player* player, trace_writer* trace)
+    : _caps{caps}, _options{options}, _font{font}, _terminal{terminal}, _scheduler{scheduler}, _latency{latency},
+      _tracking_latency{options.stats && !player}, _recorder{recorder}, _player{player}, _trace{trace}
 {
 }
 
 bool engine::run()
 {
-    screen screen(_caps, _options);
-    status status{screen};
-
-    static auto chomp_macro = std::string{};
-    static auto short_chomp_macro = std::string{};
-    if (chomp_macro.empty()) {
-        chomp_macro = screen.define_macro(3, [&]() {
-            screen.play_sound(7);
-            screen.play_sound(10);
-        });
-        short_chomp_macro = screen.define_macro(4, [&]() {
-            screen.play_sound(10);
-        });
+    _terminal.start_input();
+    _scheduler.reset();
+    _latency.reset();
+
+    // The game logic doesn't do any I/O of its own, so it's our job to feed
+    // it the keyboard input, and wait for whatever delay it requests between
+    // each step.
+    auto session = game{_caps, _options, _font, _output()};
+    while (!_terminal.exit_requested() && !session.over() && !_replay_finished()) {
+        [[maybe_unused]] const auto allocations = allocation_counter::count();
+        // When replaying a session, the recorded keys take the place of the
+        // keyboard, and each step's state is checked against the recording.
+        const auto input = _player ? _player->next_key() : _terminal.read_key();
+        if (_tracking_latency && input != key::none) _latency.key_read(_terminal.key_time());
+        if (_trace) _trace->begin_frame();
+        const auto result = session.step(input);
+        if (_tracking_latency) _track_latency(session, result);
+        if (_trace && _trace->keyframe_due()) _trace->keyframe(session.snapshot());
+        if (_recorder) _recorder->record(input, result);
+        if (_player) _player->verify(result);
+        if (!result.game_over && !_terminal.exit_requested())
+            _scheduler.wait(result.delay);
+        // Once a wave is under way, the frame loop shouldn't be allocating.
+        assert(!result.steady || allocation_counter::count() == allocations);
     }
 
-    for (auto wave = 1; !screen.exit_requested(); wave++) {
-        if (wave == 100) wave = 80;
-        if (wave % 4 == 0) status.gain_life();
-
-        // In the original arcade game the speed increases almost every wave,
-        // but our implementation is much simpler. The first four waves are
-        // about the same as the starting arcade speed, and then from wave
-        // five onwards it's 50% faster.
-        const auto frames_per_move = (wave > 4 ? 2 : 3);
-
-        _font.init(wave);
-        level level{screen, wave};
-        snake snake{screen, level};
-        level.init_map();
-        status.init(wave);
-        level.init_croutons();
-        snake.init();
-
-        screen.reset_keys();
-        while (!screen.exit_requested() && !level.complete()) {
-            auto reset_key = false;
-            switch (screen.key_pressed()) {
-                case key::up:
-                    reset_key = snake.turn(-1, 0);
-                    break;
-                case key::down:
-                    reset_key = snake.turn(+1, 0);
-                    break;
-                case key::right:
-                    reset_key = snake.turn(0, +1);
-                    break;
-                case key::left:
-                    reset_key = snake.turn(0, -1);
-                    break;
-            }
-            if (reset_key) screen.reset_keys();
-
-            snake.move();
-            const auto [snake_y, snake_x] = snake.position();
-            if (level.eat_crouton(snake_y, snake_x)) {
-                status.add_points(level.points_per_crouton());
-                snake.grow();
-            }
-
-            status.update(frames_per_move);
-            level.update(frames_per_move);
-
-            if (snake.is_dead() || status.out_of_time()) {
-                status.lose_life();
-                if (snake.erase()) {
-                    screen.reset();
-                    screen.set_palette(color::snake, palette::bright_red);
-                    if (status.out_of_time()) {
-                        status.init(wave);
-                        _display_time_out(screen);
-                        screen.reset();
-                    }
-                    if (status.game_over()) {
-                        status.init(wave);
-                        _display_game_over(screen);
-                        break;
-                    }
-                    status.reset_time();
-                    status.init(wave);
-                    level.init_map();
-                    level.init_croutons();
-                    snake.init();
-                    screen.reset_keys();
-                }
-            }
-
-            // We're stretching the definition of a second here so the default
-            // frame rate is slow enough to support the two-note chomp sound.
-            const auto time_between_moves = frames_per_move * 1050ms / _options.fps;
-            if (snake.just_eaten()) {
-                if (time_between_moves >= 62ms)
-                    screen.invoke_macro(chomp_macro);
-                else if (time_between_moves >= 31ms)
-                    screen.invoke_macro(short_chomp_macro);
-            }
-            screen.pause(time_between_moves);
-        }
-
-        if (status.game_over()) {
-            break;
-        } else if (level.complete()) {
-            status.apply_bonus();
-            status.reset_time();
-            screen.reset();
-        }
-    }
+    _terminal.stop_input();
+    return !_terminal.exit_requested() && !_replay_finished();
+}
 
-    screen.shutdown_keyboard();
-    return !screen.exit_requested();
+render_sink& engine::_output() const
+{
+    // When tracing, the output goes through the trace writer on its way to
+    // the terminal.
+    if (_trace) return *_trace;
+    return _terminal;
 }
 
-void engine::_display_time_out(screen& screen)
+void engine::_track_latency(game& session, const step_result& result)
 {
-    screen.set_charset("B");
-    screen.write(11, 9, "", color::yellow);
-    for (auto ch : "NIBBLER RAN OUT OF TIME") {
-        screen.write(ch);
-        screen.pause(66ms);
+    // The output has been flushed by the time the step returns. To find out
+    // when the terminal has actually displayed it, we follow the move with a
+    // CPR probe, which can't be answered until everything before it has been
+    // processed. It's sent through the screen, so it uses the same form of
+    // control sequence as the rest of the output.
+    if (const auto probe = _latency.awaited_probe()) {
+        if (const auto answered = _terminal.probe_answered_at(*probe))
+            _latency.key_displayed(*answered);
+    }
+    if (result.key_used && _latency.key_applied(latency_tracker::clock::now())) {
+        _latency.probe_sent(_terminal.probes_sent());
+        session.probe_terminal();
     }
-    screen.set_charset(" @");
-    screen.pause(1s);
 }
 
-void engine::_display_game_over(screen& screen)
+bool engine::_replay_finished() const
 {
-    screen.set_charset("B");
-    screen.write(12, 16, "GAME OVER", color::red);
-    screen.set_charset(" @");
-    screen.flush();
+    return _player && _player->done();
 }
@@ -5,23 +5,37 @@
 #pragma once
 
 class capabilities;
+class game;
+class latency_tracker;
 class options;
-class screen;
+class replay_player;
+class replay_recorder;
+class render_sink;
+class scheduler;
 class soft_font;
+class terminal;
+class trace_writer;
+struct step_result;
 
 class engine {
 public:
-    static constexpr int width = 38;
-    static constexpr int height = 22;
-
-    engine(const capabilities& caps, const options& options, soft_font& font);
+    engine(const capabilities& caps, const options& options, soft_font& font, terminal& terminal, scheduler& scheduler,
+           latency_tracker& latency, replay_recorder* recorder, replay_player* player, trace_writer* trace);
     bool run();
 
 private:
-    void _display_time_out(screen& screen);
-    void _display_game_over(screen& screen);
+    bool _replay_finished() const;
+    render_sink& _output() const;
+    void _track_latency(game& session, const step_result& result);
 
     const capabilities& _caps;
     const options& _options;
     soft_font& _font;
+    terminal& _terminal;
+    scheduler& _scheduler;
+    latency_tracker& _latency;
+    const bool _tracking_latency;
+    replay_recorder* const _recorder;
+    replay_player* const _player;
+    trace_writer* const _trace;
 };
@@ -5,9 +5,10 @@
 #include "font.h"
 
 #include "capabilities.h"
+#include "profiles.h"
+#include "sink.h"
 
 #include <array>
-#include <iostream>
 #include <string>
 #include <string_view>
 
@@ -605,31 +606,6 @@ namespace {
 
     constexpr auto croutons = std::to_array({0, 0, 1, 2, 3, 4, 5, 0, 6, 7, 2, 1, 4, 5, 3, 2, 7, 8, 1, 4, 3, 5, 6, 2, 4, 0, 5, 2, 4, 7, 8, 5});
 
-    auto guess_font_size(const int terminal_id)
-    {
-        switch (terminal_id) {
-            case 1:  // VT220 - 8x10
-            case 2:  // VT240 - 8x10
-                return soft_font::size_8x10;
-            case 24:  // VT320 - 15x12
-            case 42:  // VT1000 - unknown, assumed VT320 compatible
-                return soft_font::size_15x12;
-            case 18:  // VT330 - 10x20
-            case 19:  // VT340 - 10x20
-                return soft_font::size_10x20;
-            case 32:  // VT382J - 12x30
-            case 44:  // VT382T - 12x30
-                return soft_font::size_12x30;
-            case 41:  // VT420 - 10x16
-            case 61:  // VT510 - 10x16
-            case 64:  // VT520 - 10x16
-            case 65:  // VT525 - 10x16
-            case 66:  // VTStar - 10x16
-            default:  // Unknown - assume 10x16
-                return soft_font::size_10x16;
-        }
-    }
-
     std::string get_font(const auto font_size)
     {
         switch (font_size) {
@@ -683,8 +659,8 @@ namespace {
 
 }  // namespace
 
-soft_font::soft_font(const capabilities& caps)
-    : _font_size{guess_font_size(caps.terminal_id)}
+soft_font::soft_font(const capabilities& caps, render_sink& sink)
+    : _sink{sink}, _profile{profile_for_terminal(caps.terminal_id)}, _font_size{_profile.font_size}
 {
     if (caps.has_soft_fonts) {
         auto font_data = get_font(_font_size);
@@ -693,31 +669,40 @@ soft_font::soft_font(const capabilities& caps)
         for (auto i = 0; i < font_data.size(); i++)
             if (font_data[i] == '\n')
                 font_data.erase(i--, 1);
-        std::cout << "\033P" << font_data << "\033\\";
+        auto output = "\033P" + font_data + "\033\\";
         // VTStar seems to get itself stuck when downloading a soft font, but
         // that can be fixed by flooding it with a bunch of SGR sequences.
-        for (auto i = 0; i < 100; i++)
-            std::cout << "\033[0;1m";
-        std::cout << "\033[m";
+        if (_profile.stalls_after_font) {
+            for (auto i = 0; i < 100; i++)
+                output += "\033[0;1m";
+            output += "\033[m";
+        }
         // We enable the new font by default.
-        std::cout << "\033( @";
+        output += "\033( @";
+        _sink.write(output);
     }
 }
 
 soft_font::~soft_font()
 {
     // Make sure the ASCII character set is restored on exit.
-    std::cout << "\033(B";
+    _sink.write("\033(B");
 }
 
 void soft_font::init(const int wave)
 {
     // Each wave potentially has a differently style of crouton, and we can't
     // fit them all in the same font, so we redefine the crouton sprites at the
-    // start of every level.
+    // start of every level. But if the sprites are already loaded, either
+    // because they were prepared in advance, or the previous wave used the
+    // same style, there's no need to send them again.
     const auto index = croutons[(wave - 1) % croutons.size()];
+    if (index == _crouton_index) return;
+    _crouton_index = index;
     const auto font_header = get_font_header(_font_size);
     const auto& crouton_sprites = get_crouton_sprites(_font_size);
-    std::cout << "\033P0;91;" << font_header << "{ @" << crouton_sprites[index * 2] << "\033\\";
-    std::cout << "\033P0;93;" << font_header << "{ @" << crouton_sprites[index * 2 + 1] << "\033\\";
+    auto output = std::string{};
+    output += "\033P0;91;" + std::string{font_header} + "{ @" + crouton_sprites[index * 2] + "\033\\";
+    output += "\033P0;93;" + std::string{font_header} + "{ @" + crouton_sprites[index * 2 + 1] + "\033\\";
+    _sink.write(output);
 }
@@ -5,6 +5,8 @@
 #pragma once
 
 class capabilities;
+class render_sink;
+struct terminal_profile;
 
 class soft_font {
 public:
@@ -16,10 +18,13 @@ public:
         size_10x16
     };
 
-    soft_font(const capabilities& caps);
+    soft_font(const capabilities& caps, render_sink& sink);
     ~soft_font();
     void init(const int wave);
 
 private:
+    render_sink& _sink;
+    const terminal_profile& _profile;
     const size _font_size;
+    int _crouton_index = -1;
 };
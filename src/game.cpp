@@ -0,0 +1,258 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#include "game.h"
+
+#include "coloring.h"
+#include "font.h"
+#include "levels.h"
+#include "options.h"
+#include "sink.h"
+#include "snake.h"
+#include "state_hash.h"
+
+#include <chrono>
+
+using namespace std::chrono_literals;
+
+game::game(const capabilities& caps, const options& options, soft_font& font, render_sink& sink)
+    : _options{options}, _font{font}, _sink{sink}, _screen{screen::create(caps, options, sink)}, _status{*_screen},
+      _checker{caps, options, *_screen, sink}, _game{_play()}
+{
+    _chomp_macro = _screen->define_macro(3, [&]() {
+        _screen->play_sound(7);
+        _screen->play_sound(10);
+    });
+    _short_chomp_macro = _screen->define_macro(4, [&]() {
+        _screen->play_sound(10);
+    });
+}
+
+step_result game::step(const key input)
+{
+    // The game itself runs as a coroutine, which we resume for one step at a
+    // time. It yields the delay that's required before the next step, but
+    // it's up to the caller to decide whether to actually wait that long.
+    _result = {};
+    if (_game.done()) {
+        _result.game_over = true;
+        return _result;
+    }
+    if (input != key::none) {
+        _pending_key = input;
+        _key_age = 0;
+    }
+    _result.delay = _game.resume();
+    // Screen checks are only worth doing in the middle of a wave, when the
+    // link isn't busy with the bursts of output from initialization.
+    if (_result.steady && !_screen->output_held())
+        _checker.update(_result.delay);
+    _screen->flush();
+    if (_result.steady)
+        _track_lag();
+    return _result;
+}
+
+bool game::over() const
+{
+    return _game.done();
+}
+
+screen_snapshot game::snapshot() const
+{
+    return _screen->snapshot();
+}
+
+void game::probe_terminal()
+{
+    _screen->probe_terminal();
+}
+
+animation game::_play()
+{
+    for (auto wave = _options.wave;; wave = _next_wave(wave)) {
+        _sink.begin_wave(wave);
+        if (wave % 4 == 0) _status.gain_life();
+
+        // In the original arcade game the speed increases almost every wave,
+        // but our implementation is much simpler. The first four waves are
+        // about the same as the starting arcade speed, and then from wave
+        // five onwards it's 50% faster.
+        const auto frames_per_move = (wave > 4 ? 2 : 3);
+
+        // We're stretching the definition of a second here so the default
+        // frame rate is slow enough to support the two-note chomp sound.
+        const auto time_between_moves = std::chrono::nanoseconds{frames_per_move * 1050ms} / _options.fps;
+
+        _screen->flush();
+        _font.init(wave);
+        level level{*_screen, wave};
+        snake snake{*_screen, level};
+        level.init_map();
+        _status.init(wave);
+        level.init_croutons();
+        co_await snake.init();
+
+        // On a laggy link, a turn will often arrive a move or two after the
+        // junction where it was intended. If it's within the grace period, the
+        // snake is rolled back to that junction, and the missed moves are then
+        // replayed in the new direction. A key that is still pending from
+        // before the junction doesn't count, though, since it was already
+        // rejected there.
+        auto replay_moves = 0;
+        const auto turn = [&](const int dy, const int dx) {
+            if (snake.turn(dy, dx)) return true;
+            replay_moves = snake.late_turn(dy, dx, _options.grace, _key_age);
+            return replay_moves > 0;
+        };
+
+        _pending_key = key::none;
+        while (!level.complete()) {
+            // If the terminal has fallen too far behind, the game carries on
+            // without drawing anything until it catches up, and then we send
+            // the net effect of all those moves in one update.
+            if (_falling_behind())
+                _screen->hold_output();
+
+            auto reset_key = false;
+            replay_moves = 0;
+            switch (_pending_key) {
+                case key::up:
+                    reset_key = turn(-1, 0);
+                    break;
+                case key::down:
+                    reset_key = turn(+1, 0);
+                    break;
+                case key::right:
+                    reset_key = turn(0, +1);
+                    break;
+                case key::left:
+                    reset_key = turn(0, -1);
+                    break;
+            }
+            if (reset_key) {
+                _pending_key = key::none;
+                _result.key_used = true;
+            }
+
+            auto chomp = false;
+            for (auto i = 0; i <= replay_moves && !snake.is_dead(); i++) {
+                snake.move();
+                const auto [snake_y, snake_x] = snake.position();
+                if (level.eat_crouton(snake_y, snake_x)) {
+                    _status.add_points(level.points_per_crouton());
+                    snake.grow();
+                    chomp = true;
+                    _result.crouton_eaten = true;
+                }
+            }
+            _key_age++;
+
+            _status.update(frames_per_move);
+            level.update(frames_per_move);
+
+            if (snake.is_dead() || _status.out_of_time()) {
+                _screen->release_output();
+                _status.lose_life();
+                _result.life_lost = true;
+                co_await snake.erase();
+                _screen->reset();
+                _screen->set_palette(color::snake, palette::bright_red);
+                if (_status.out_of_time()) {
+                    _status.init(wave);
+                    co_await _display_time_out();
+                    _screen->reset();
+                }
+                if (_status.game_over()) {
+                    _status.init(wave);
+                    _display_game_over();
+                    _result.game_over = true;
+                    co_return;
+                }
+                _status.reset_time();
+                _status.init(wave);
+                level.init_map();
+                level.init_croutons();
+                co_await snake.init();
+                _pending_key = key::none;
+            }
+
+            if (chomp) {
+                if (time_between_moves >= 62ms)
+                    _screen->invoke_macro(_chomp_macro);
+                else if (time_between_moves >= 31ms)
+                    _screen->invoke_macro(_short_chomp_macro);
+            }
+            _result.steady = !_result.life_lost;
+            if (_result.steady) {
+                auto hash = state_hash{};
+                snake.hash_state(hash);
+                level.hash_state(hash);
+                _status.hash_state(hash);
+                _result.checksum = hash.value();
+            }
+            co_yield time_between_moves;
+        }
+
+        // While the time bonus is being counted down, the link is mostly
+        // idle, so that's a good time to prepare the next wave's font.
+        _screen->release_output();
+        _result.wave_complete = true;
+        co_await interleave(_status.apply_bonus(), _prepare_wave(_next_wave(wave)));
+        _status.reset_time();
+        _screen->reset();
+    }
+}
+
+animation game::_prepare_wave(const int wave)
+{
+    _screen->flush();
+    _font.init(wave);
+    co_return;
+}
+
+animation game::_display_time_out()
+{
+    constexpr auto message = std::string_view{"NIBBLER RAN OUT OF TIME"};
+    _screen->set_charset("B");
+    for (auto i = 0; i < message.size(); i++) {
+        _screen->write(11, 9 + i, message[i], color::yellow);
+        co_yield 66ms;
+    }
+    _screen->set_charset(" @");
+    co_yield 1s;
+}
+
+void game::_display_game_over()
+{
+    _screen->set_charset("B");
+    _screen->write(12, 16, "GAME OVER", color::red);
+    _screen->set_charset(" @");
+    _screen->flush();
+}
+
+void game::_track_lag()
+{
+    // We keep a single probe in flight, and count the moves until it's
+    // answered, which tells us how far behind the terminal is running. Once
+    // it has caught up, any held output is released ahead of the next probe.
+    if (_options.catchup == 0) return;
+    if (_screen->probe_pending())
+        _moves_behind++;
+    else {
+        _moves_behind = 0;
+        _screen->release_output();
+        _screen->probe_terminal();
+    }
+}
+
+bool game::_falling_behind() const
+{
+    return _options.catchup > 0 && _moves_behind >= _options.catchup;
+}
+
+int game::_next_wave(const int wave)
+{
+    return wave == 99 ? 80 : wave + 1;
+}
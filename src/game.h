@@ -0,0 +1,78 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include "animation.h"
+#include "integrity.h"
+#include "screen.h"
+#include "status.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class capabilities;
+class options;
+class render_sink;
+class soft_font;
+
+enum class key {
+    none,
+    left,
+    right,
+    up,
+    down
+};
+
+struct step_result {
+    animation::duration delay = {};
+    bool key_used = false;
+    bool crouton_eaten = false;
+    bool life_lost = false;
+    bool wave_complete = false;
+    bool game_over = false;
+    // Set when the step was an ordinary move in the middle of a wave, with
+    // nothing being initialized or torn down.
+    bool steady = false;
+    // A hash of the game state after an ordinary move, for verifying replays.
+    uint32_t checksum = 0;
+};
+
+class game {
+public:
+    static constexpr int width = 38;
+    static constexpr int height = 22;
+
+    game(const capabilities& caps, const options& options, soft_font& font, render_sink& sink);
+    game(const game&) = delete;
+    game& operator=(const game&) = delete;
+    step_result step(const key input);
+    bool over() const;
+    screen_snapshot snapshot() const;
+    void probe_terminal();
+
+private:
+    animation _play();
+    animation _prepare_wave(const int wave);
+    animation _display_time_out();
+    void _display_game_over();
+    static int _next_wave(const int wave);
+    void _track_lag();
+    bool _falling_behind() const;
+
+    const options& _options;
+    soft_font& _font;
+    render_sink& _sink;
+    const std::unique_ptr<screen> _screen;
+    status _status;
+    integrity_checker _checker;
+    std::string _chomp_macro;
+    std::string _short_chomp_macro;
+    key _pending_key = key::none;
+    int _key_age = 0;
+    int _moves_behind = 0;
+    step_result _result;
+    animation _game;
+};
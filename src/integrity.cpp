@@ -0,0 +1,139 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#include "integrity.h"
+
+#include "capabilities.h"
+#include "game.h"
+#include "options.h"
+#include "screen.h"
+#include "sink.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+    constexpr auto report_timeout = 2s;
+    constexpr auto max_calibration_attempts = 3;
+
+}  // namespace
+
+integrity_checker::integrity_checker(const capabilities& caps, const options& options, screen& screen, render_sink& sink)
+    : _screen{screen}, _sink{sink}, _enabled{options.verify > 0 && caps.has_rectangle_ops},
+      _bytes_per_second{static_cast<double>(options.verify)}
+{
+}
+
+void integrity_checker::update(const animation::duration elapsed)
+{
+    if (!_enabled) return;
+
+    // The budget accumulates with the time between steps, but we don't let
+    // it build up more than a second's worth, so a long pause can't be
+    // followed by a burst of checks.
+    const auto seconds = std::chrono::duration<double>{elapsed}.count();
+    _budget = std::min(_budget + _bytes_per_second * seconds, _bytes_per_second);
+
+    if (_awaiting_report) {
+        const auto report = _sink.poll_checksum();
+        if (report && report->id == _request_id) {
+            _awaiting_report = false;
+            _handle_report(report->checksum);
+        } else {
+            _request_age += elapsed;
+            if (_request_age < report_timeout) return;
+            // If we never get a report during calibration, the terminal most
+            // likely doesn't support DECRQCRA. Otherwise it may just have
+            // been lost on the line, so we move on to the next check.
+            _awaiting_report = false;
+            if (!_calibrated) {
+                _enabled = false;
+                return;
+            }
+        }
+    }
+    _send_request();
+}
+
+void integrity_checker::_handle_report(const int checksum)
+{
+    if (!_calibrated) {
+        for (auto i = 0; i < _variants.size(); i++) {
+            if (_expected[i] == checksum) {
+                _variant = _variants[i];
+                _calibrated = true;
+                return;
+            }
+        }
+        if (++_calibration_attempts >= max_calibration_attempts)
+            _enabled = false;
+        return;
+    }
+    if (_expected[0] == checksum) return;
+
+    // On a mismatch we split the region in half and check each part, until
+    // it's small enough that repainting the whole thing is cheaper than
+    // another round of checks. Dropped bytes usually shift the rest of a row
+    // out of place, so that's about a row's worth of cells.
+    const auto [top, left, bottom, right] = _request_region;
+    if ((bottom - top + 1) * (right - left + 1) <= game::width) {
+        for (auto y = top; y <= bottom; y++) {
+            for (auto x = left; x <= right; x++)
+                _budget -= _screen.repaint(y, x);
+        }
+    } else if (_pending_count + 2 <= _pending_regions.size()) {
+        if (top < bottom) {
+            const auto middle = (top + bottom) / 2;
+            _pending_regions[_pending_count++] = {middle + 1, left, bottom, right};
+            _pending_regions[_pending_count++] = {top, left, middle, right};
+        } else {
+            const auto middle = (left + right) / 2;
+            _pending_regions[_pending_count++] = {top, middle + 1, bottom, right};
+            _pending_regions[_pending_count++] = {top, left, bottom, middle};
+        }
+    }
+}
+
+void integrity_checker::_send_request()
+{
+    // A request is about 20 bytes, and the report coming back is similar,
+    // so we wait until the budget can cover that before sending anything.
+    constexpr auto request_cost = 20.0;
+    if (_budget < request_cost) return;
+
+    const auto area = _pending_count > 0 ? _pending_regions[--_pending_count] : region{1, 1, game::height, game::width};
+    if (_calibrated)
+        _expected[0] = _expected_checksum(area, _variant);
+    else {
+        for (auto i = 0; i < _variants.size(); i++)
+            _expected[i] = _expected_checksum(area, _variants[i]);
+    }
+    _request_id = _request_id % 255 + 1;
+    _request_region = area;
+    _request_age = {};
+    _awaiting_report = true;
+    _budget -= _screen.request_checksum(_request_id, area.top, area.left, area.bottom, area.right);
+}
+
+int integrity_checker::_expected_checksum(const region& area, const variant& variant) const
+{
+    // The terminal sums the character codes (and possibly the attributes) of
+    // every cell in the area, and reports the negated 16-bit result.
+    auto total = 0;
+    for (auto y = area.top; y <= area.bottom; y++) {
+        for (auto x = area.left; x <= area.right; x++) {
+            const auto& cell = _screen.cell(y, x);
+            if (cell.ch == 0)
+                total += variant.blank;
+            else {
+                total += static_cast<unsigned char>(cell.ch);
+                if (variant.attributes) total += cell.attributes;
+            }
+        }
+    }
+    return -total & 0xFFFF;
+}
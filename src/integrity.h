@@ -0,0 +1,60 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include "animation.h"
+
+#include <array>
+
+class capabilities;
+class options;
+class render_sink;
+class screen;
+
+// Uses DECRQCRA to compare the terminal's copy of the game area with the
+// screen model, and repairs any cells that have been damaged by dropped
+// bytes. It only sends as much as the configured byte budget allows.
+class integrity_checker {
+public:
+    integrity_checker(const capabilities& caps, const options& options, screen& screen, render_sink& sink);
+    void update(const animation::duration elapsed);
+
+private:
+    struct region {
+        int top;
+        int left;
+        int bottom;
+        int right;
+    };
+
+    // Terminals differ in how they sum blank cells and attributes, so until
+    // we've seen a report that matches one of these variants, we don't know
+    // which one to use.
+    struct variant {
+        int blank;
+        bool attributes;
+    };
+    static constexpr auto _variants = std::to_array<variant>({{' ', true}, {' ', false}, {0, true}, {0, false}});
+
+    void _handle_report(const int checksum);
+    void _send_request();
+    int _expected_checksum(const region& area, const variant& variant) const;
+
+    screen& _screen;
+    render_sink& _sink;
+    bool _enabled;
+    double _bytes_per_second;
+    double _budget = 0;
+    bool _calibrated = false;
+    int _calibration_attempts = 0;
+    variant _variant = {};
+    std::array<region, 32> _pending_regions = {};
+    int _pending_count = 0;
+    bool _awaiting_report = false;
+    int _request_id = 0;
+    region _request_region = {};
+    std::array<int, _variants.size()> _expected = {};
+    animation::duration _request_age = {};
+};
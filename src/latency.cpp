@@ -0,0 +1,107 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#include "latency.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+void latency_tracker::reset()
+{
+    // Anything still outstanding from the last game can't be matched up with
+    // a move any more.
+    _key_time.reset();
+    _displaying_key_time.reset();
+    _displaying_probe.reset();
+}
+
+void latency_tracker::key_read(const clock::time_point time)
+{
+    // The game only holds on to the latest key, so if an earlier one hasn't
+    // been applied yet, it never will be.
+    _key_time = time;
+}
+
+bool latency_tracker::key_applied(const clock::time_point flushed)
+{
+    // We only keep one probe in flight, so if the terminal hasn't answered
+    // the last one yet, this key just gets the flush time. The return value
+    // tells the caller whether to send a probe for it.
+    if (!_key_time) return false;
+    const auto key_time = *std::exchange(_key_time, std::nullopt);
+    _flushed.record(flushed - key_time);
+    if (_displaying_key_time && flushed - *_displaying_key_time >= probe_timeout) {
+        _displaying_key_time.reset();
+        _displaying_probe.reset();
+        _lost_probes++;
+    }
+    if (_displaying_key_time) return false;
+    _displaying_key_time = key_time;
+    return true;
+}
+
+void latency_tracker::probe_sent(const uint32_t probe)
+{
+    _displaying_probe = probe;
+}
+
+std::optional<uint32_t> latency_tracker::awaited_probe() const
+{
+    return _displaying_probe;
+}
+
+void latency_tracker::key_displayed(const clock::time_point displayed)
+{
+    if (_displaying_key_time) _displayed.record(displayed - *_displaying_key_time);
+    _displaying_key_time.reset();
+    _displaying_probe.reset();
+}
+
+void latency_tracker::report(std::ostream& out) const
+{
+    _flushed.report(out, "Input latency (key to flush)");
+    _displayed.report(out, "Input latency (key to display)");
+    if (_lost_probes) out << "  " << _lost_probes << " probes were never answered\n";
+}
+
+void latency_tracker::histogram::record(const clock::duration latency)
+{
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(latency).count();
+    auto bucket = 0;
+    while (bucket < bucket_limits.size() && ms >= bucket_limits[bucket])
+        bucket++;
+    _buckets[bucket]++;
+    _count++;
+    _max = std::max(_max, latency);
+}
+
+void latency_tracker::histogram::report(std::ostream& out, const char* name) const
+{
+    // The percentiles can only be as precise as the buckets, so they're
+    // reported as the upper limit of the bucket they fall in.
+    if (_count == 0) return;
+    const auto max = std::chrono::duration_cast<std::chrono::milliseconds>(_max).count();
+    const auto describe = [](const int bucket) {
+        return bucket < bucket_limits.size() ? "< " + std::to_string(bucket_limits[bucket]) + "ms"
+                                             : ">= " + std::to_string(bucket_limits.back()) + "ms";
+    };
+    out << name << ": " << _count << " keys\n";
+    out << "  p50 " << describe(_percentile(0.5)) << ", p99 " << describe(_percentile(0.99)) << ", max " << max << "ms\n";
+    for (auto i = 0; i < _buckets.size(); i++) {
+        if (_buckets[i] == 0) continue;
+        out << "  " << describe(i) << ": " << _buckets[i] << "\n";
+    }
+}
+
+int latency_tracker::histogram::_percentile(const double fraction) const
+{
+    const auto target = std::max(1, static_cast<int>(fraction * _count + 0.999));
+    auto total = 0;
+    for (auto i = 0; i < _buckets.size(); i++) {
+        total += _buckets[i];
+        if (total >= target) return i;
+    }
+    return int(_buckets.size()) - 1;
+}
@@ -0,0 +1,54 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+
+// Measures the time from each key press to the move that applied it being
+// flushed, and, when the terminal answers a CPR probe sent after that move,
+// to the terminal having actually displayed it. The results are collected in
+// fixed histograms, so nothing is allocated while the game is running.
+class latency_tracker {
+public:
+    using clock = std::chrono::steady_clock;
+
+    void reset();
+    void key_read(const clock::time_point time);
+    bool key_applied(const clock::time_point flushed);
+    void probe_sent(const uint32_t probe);
+    std::optional<uint32_t> awaited_probe() const;
+    void key_displayed(const clock::time_point displayed);
+    void report(std::ostream& out) const;
+
+private:
+    // If a probe hasn't been answered in this time, we assume the reply was
+    // lost, so we can carry on measuring with a new one.
+    static constexpr auto probe_timeout = std::chrono::seconds{5};
+    static constexpr auto bucket_limits = std::to_array<int>({1, 2, 5, 10, 20, 30, 50, 75, 100, 150, 200, 300, 500, 1000, 2000, 5000});
+
+    class histogram {
+    public:
+        void record(const clock::duration latency);
+        void report(std::ostream& out, const char* name) const;
+
+    private:
+        int _percentile(const double fraction) const;
+
+        std::array<int, bucket_limits.size() + 1> _buckets = {};
+        int _count = 0;
+        clock::duration _max = {};
+    };
+
+    std::optional<clock::time_point> _key_time;
+    std::optional<clock::time_point> _displaying_key_time;
+    std::optional<uint32_t> _displaying_probe;
+    int _lost_probes = 0;
+    histogram _flushed;
+    histogram _displayed;
+};
@@ -4,10 +4,13 @@
 
 #pragma once
 
-#include <array>
+#include "bitboard.h"
+
 #include <string>
 
 class screen;
+class state_hash;
+struct level_descriptor;
 
 class level {
 public:
@@ -16,24 +19,22 @@ public:
     void init_map();
     void init_croutons();
     void update(const int elapsed_frames);
+    void redraw_cell(const int snake_y, const int snake_x) const;
     bool is_path(const int snake_y, const int snake_x) const;
+    int exits(const int snake_y, const int snake_x) const;
     bool eat_crouton(const int snake_y, const int snake_x);
     bool complete() const;
+    void hash_state(state_hash& hash) const;
 
 private:
-    void _build_map();
-    void _build_croutons();
     void _build_palette();
-    int _wall_shape(const int y, const int x) const;
     bool _is_path(const int y, const int x) const;
-    bool& _is_path(const int y, const int x);
 
     screen& _screen;
     int _wave = 0;
+    const level_descriptor& _descriptor;
     std::string _palette_macro_1;
     std::string _palette_macro_2;
-    std::array<bool, 21 * 21> _path = {};
-    std::array<bool, 17 * 17> _croutons = {};
-    int _croutons_remaining = 0;
+    bitboard<17, 17> _croutons;
     int _frame = 0;
 };
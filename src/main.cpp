@@ -3,15 +3,23 @@
 // Distributed under the MIT License
 
 #include "capabilities.h"
+#include "clock.h"
 #include "coloring.h"
 #include "engine.h"
 #include "font.h"
+#include "game.h"
+#include "latency.h"
 #include "options.h"
 #include "os.h"
+#include "profiles.h"
+#include "replay.h"
+#include "scheduler.h"
+#include "terminal.h"
+#include "trace.h"
 
 #include <chrono>
 #include <iostream>
-#include <thread>
+#include <optional>
 
 using namespace std::chrono_literals;
 
@@ -22,18 +30,18 @@ static bool check_compatibility(const capabilities& caps, const options& options
         std::cout << "Try 'vtnibbler --yolo' to bypass the compatibility checks.\n";
         return false;
     }
-    if (caps.height < engine::height) {
-        std::cout << "VT Nibbler requires a minimum screen height of " << engine::height << ".\n";
+    if (caps.height < game::height) {
+        std::cout << "VT Nibbler requires a minimum screen height of " << game::height << ".\n";
         return false;
     }
-    if (caps.width < engine::width) {
-        std::cout << "VT Nibbler requires a minimum screen width of " << engine::width << ".\n";
+    if (caps.width < game::width) {
+        std::cout << "VT Nibbler requires a minimum screen width of " << game::width << ".\n";
         return false;
     }
     return true;
 }
 
-static auto title_banner(const capabilities& caps)
+static auto title_banner(const capabilities& caps, game_clock& clock)
 {
     constexpr auto title = "VT NIBBLER";
     const auto y = caps.height / 2;
@@ -42,13 +50,16 @@ static auto title_banner(const capabilities& caps)
     std::cout << "\033[" << (y + 1) << ';' << x << "H\033#4" << title;
     std::cout.flush();
 
-    return [=]() {
-        std::this_thread::sleep_for(3s);
+    const auto keeps_double_width = profile_for_terminal(caps.terminal_id).keeps_double_width;
+    return [=, &clock]() {
+        clock.sleep_for(3s);
         // MLTerm doesn't reset double-width lines correctly, so we need to
         // manually reset the title banner line before starting the game.
-        std::cout << "\033[" << y << "H\033[2K\033#5";
-        std::cout << "\033[" << (y + 1) << "H\033[2K\033#5";
-        std::cout.flush();
+        if (keeps_double_width) {
+            std::cout << "\033[" << y << "H\033[2K\033#5";
+            std::cout << "\033[" << (y + 1) << "H\033[2K\033#5";
+            std::cout.flush();
+        }
     };
 }
 
@@ -60,6 +71,39 @@ int main(const int argc, const char* argv[])
     if (options.exit)
         return 1;
 
+    // A replay runs on virtual time, with the same options that affect the
+    // game logic as the session was recorded with.
+    auto player = std::optional<replay_player>{};
+    if (!options.replay.empty()) {
+        player.emplace(options.replay);
+        if (!player->is_open()) {
+            std::cout << "VT Nibbler: unable to read replay file '" << options.replay << "'\n";
+            return 1;
+        }
+        options.grace = player->grace();
+        options.wave = player->wave();
+        options.timescale = 0;
+    }
+    auto recorder = std::optional<replay_recorder>{};
+    if (!options.record.empty()) {
+        recorder.emplace(options.record, options);
+        if (!recorder->is_open()) {
+            std::cout << "VT Nibbler: unable to write record file '" << options.record << "'\n";
+            return 1;
+        }
+    }
+
+    auto term = terminal{};
+    auto trace = std::optional<trace_writer>{};
+    if (!options.trace.empty()) {
+        trace.emplace(options.trace, term);
+        if (!trace->is_open()) {
+            std::cout << "VT Nibbler: unable to write trace file '" << options.trace << "'\n";
+            return 1;
+        }
+    }
+    render_sink& output = trace ? static_cast<render_sink&>(*trace) : term;
+
     capabilities caps;
     if (!check_compatibility(caps, options))
         return 1;
@@ -80,15 +124,20 @@ int main(const int argc, const char* argv[])
     // Hide the status line.
     std::cout << "\033[0$~";
     // Display title banner
-    const auto clear_banner = title_banner(caps);
+    auto clock = game_clock{options};
+    const auto clear_banner = title_banner(caps, clock);
     // Load the soft font.
-    auto font = soft_font{caps};
+    auto font = soft_font{caps, output};
     // Setup the color assignment and palette.
     const auto colors = coloring{caps, options};
     // Clear the title banner
     clear_banner();
 
-    auto game_engine = engine{caps, options, font};
+    auto frame_scheduler = scheduler{options, clock};
+    auto latency = latency_tracker{};
+    auto game_engine = engine{caps, options, font, term, frame_scheduler, latency,
+                              recorder ? &*recorder : nullptr, player ? &*player : nullptr,
+                              trace ? &*trace : nullptr};
     while (game_engine.run()) {
     }
 
@@ -107,5 +156,16 @@ int main(const int argc, const char* argv[])
     // Show the cursor.
     std::cout << "\033[?25h";
 
+    if (options.stats) {
+        frame_scheduler.report(std::cout);
+        latency.report(std::cout);
+    }
+    if (player) {
+        if (player->divergence())
+            std::cout << "Replay diverged from the recording at step " << player->divergence() << "\n";
+        else
+            std::cout << "Replay matched the recording for " << player->steps() << " steps\n";
+    }
+
     return 0;
 }
@@ -4,6 +4,8 @@
 
 #include "options.h"
 
+#include "snake.h"
+
 #include <algorithm>
 #include <iostream>
 #include <string>
@@ -11,6 +13,7 @@
 options::options(const int argc, const char* argv[])
 {
     auto ignore_compatibility = false;
+    auto spin_set = false;
     for (auto i = 1; i < argc; i++) {
         const auto arg = std::string{argv[i]};
         if (arg == "--mono") {
@@ -28,12 +31,81 @@ options::options(const int argc, const char* argv[])
             } catch (std::exception) {
                 // ignore invalid speed
             }
+        } else if (arg == "--fps" && i + 1 < argc) {
+            try {
+                fps = std::stoi(argv[++i]);
+                fps = std::clamp(fps, 1, 1000);
+            } catch (std::exception) {
+                // ignore invalid frame rate
+            }
+        } else if (arg == "--wave" && i + 1 < argc) {
+            try {
+                wave = std::stoi(argv[++i]);
+                wave = std::clamp(wave, 1, 99);
+            } catch (std::exception) {
+                // ignore invalid wave
+            }
+        } else if (arg == "--grace" && i + 1 < argc) {
+            try {
+                grace = std::stoi(argv[++i]);
+                grace = std::clamp(grace, 0, snake::max_grace);
+            } catch (std::exception) {
+                // ignore invalid grace period
+            }
+        } else if (arg == "--spin" && i + 1 < argc) {
+            try {
+                spin_set = true;
+                spin = std::stoi(argv[++i]);
+                spin = std::clamp(spin, 0, 10000);
+            } catch (std::exception) {
+                // ignore invalid spin time
+            }
+        } else if (arg == "--timescale" && i + 1 < argc) {
+            try {
+                timescale = std::stoi(argv[++i]);
+                timescale = std::clamp(timescale, 0, 1000);
+            } catch (std::exception) {
+                // ignore invalid time scale
+            }
+        } else if (arg == "--verify" && i + 1 < argc) {
+            try {
+                verify = std::stoi(argv[++i]);
+                verify = std::clamp(verify, 0, 10000);
+            } catch (std::exception) {
+                // ignore invalid verification budget
+            }
+        } else if (arg == "--catchup" && i + 1 < argc) {
+            try {
+                catchup = std::stoi(argv[++i]);
+                catchup = std::clamp(catchup, 0, 100);
+            } catch (std::exception) {
+                // ignore invalid catch-up threshold
+            }
+        } else if (arg == "--record" && i + 1 < argc) {
+            record = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replay = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace = argv[++i];
+        } else if (arg == "--stats") {
+            stats = true;
         } else if (arg == "--help") {
             std::cout << "Usage: vtnibbler [OPTION]...\n\n";
             std::cout << "  --mono        no colors\n";
             std::cout << "  --mute        no sound effects\n";
             std::cout << "  --noblink     no blinking effects\n";
             std::cout << "  --speed N     set initial speed (1 to 10)\n";
+            std::cout << "  --fps N       set the frame rate directly (1 to 1000)\n";
+            std::cout << "  --wave N      start at wave N (1 to 99)\n";
+            std::cout << "  --grace N     accept turns up to N moves late (0 to 3)\n";
+            std::cout << "  --spin US     spin for the last US microseconds of a frame\n";
+            std::cout << "  --timescale N run N times faster (0 for no delays)\n";
+            std::cout << "  --verify N    check and repair the screen using N bytes per second\n";
+            std::cout << "  --catchup N   skip ahead when the terminal falls N moves behind\n";
+            std::cout << "  --record FILE record the session's key presses to FILE\n";
+            std::cout << "  --replay FILE replay a recorded session from FILE\n";
+            std::cout << "  --trace FILE  write a timestamped trace of the output to FILE\n";
+            std::cout << "  --stats       display frame timing and input latency on exit\n";
             std::cout << "  --yolo        bypass compatibility checks\n";
             std::cout << "  --help        display this help and exit\n";
             exit = true;
@@ -43,4 +115,10 @@ options::options(const int argc, const char* argv[])
             exit = true;
         }
     }
+    // At high frame rates, the OS is likely to oversleep by a significant
+    // part of the frame period, so unless told otherwise, we spin for the
+    // end of each frame. A negative spin time means the scheduler sizes it
+    // from the wakeup jitter it measures.
+    if (fps > 100 && !spin_set)
+        spin = -1;
 }
@@ -4,8 +4,11 @@
 
 #pragma once
 
+#include <string>
+
 class options {
 public:
+    options() = default;
     options(const int argc, const char* argv[]);
 
     bool color = true;
@@ -14,4 +17,14 @@ public:
     bool yolo = false;
     bool exit = false;
     int fps = 50;
+    int grace = 0;
+    int wave = 1;
+    int spin = 0;
+    int timescale = 1;
+    int verify = 0;
+    int catchup = 0;
+    std::string record;
+    std::string replay;
+    std::string trace;
+    bool stats = false;
 };
@@ -8,6 +8,13 @@
 
 #include <Windows.h>
 
+#include <thread>
+
+// This flag is only defined in recent versions of the Windows SDK.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
 DWORD output_mode;
 DWORD input_mode;
 
@@ -41,14 +48,36 @@ int os::getch()
     return chars_read == 1 ? static_cast<int>(ch) : -1;
 }
 
+void os::sleep_until(const std::chrono::steady_clock::time_point time)
+{
+    // The default timer resolution on Windows can be as coarse as 15ms, which
+    // is longer than a frame at high frame rates, so we use a high resolution
+    // waitable timer if the system supports one.
+    static const auto timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    const auto delay = time - std::chrono::steady_clock::now();
+    if (timer && delay.count() > 0) {
+        // A negative due time is relative, measured in 100ns intervals.
+        using intervals = std::chrono::duration<LONGLONG, std::ratio<1, 10'000'000>>;
+        auto due_time = LARGE_INTEGER{};
+        due_time.QuadPart = -std::chrono::duration_cast<intervals>(delay).count();
+        if (SetWaitableTimer(timer, &due_time, 0, NULL, NULL, FALSE)) {
+            WaitForSingleObject(timer, INFINITE);
+            return;
+        }
+    }
+    std::this_thread::sleep_until(time);
+}
+
 #endif
 
 #ifdef __linux__
 
 #include <signal.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <cerrno>
 #include <cstdio>
 
 struct termios term_attributes;
@@ -72,4 +101,16 @@ int os::getch()
     return getchar();
 }
 
+void os::sleep_until(const std::chrono::steady_clock::time_point time)
+{
+    // The steady_clock is based on CLOCK_MONOTONIC, so we can sleep until an
+    // absolute time, rather than trying to calculate a relative delay.
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    auto deadline = timespec{};
+    deadline.tv_sec = ns / 1'000'000'000;
+    deadline.tv_nsec = ns % 1'000'000'000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+    }
+}
+
 #endif
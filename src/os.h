@@ -4,9 +4,12 @@
 
 #pragma once
 
+#include <chrono>
+
 class os {
 public:
     os();
     ~os();
     static int getch();
+    static void sleep_until(const std::chrono::steady_clock::time_point time);
 };
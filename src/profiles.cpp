@@ -0,0 +1,47 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#include "profiles.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+    constexpr auto profiles = std::to_array<terminal_profile>({
+        {.id = 1, .name = "VT220", .font_size = soft_font::size_8x10},
+        {.id = 2, .name = "VT240", .font_size = soft_font::size_8x10},
+        {.id = 18, .name = "VT330", .font_size = soft_font::size_10x20},
+        {.id = 19, .name = "VT340", .font_size = soft_font::size_10x20},
+        // MLTerm identifies itself as a VT320, so we can't tell them apart.
+        {.id = 24, .name = "VT320", .font_size = soft_font::size_15x12, .keeps_double_width = true},
+        {.id = 32, .name = "VT382J", .font_size = soft_font::size_12x30},
+        {.id = 41, .name = "VT420", .font_size = soft_font::size_10x16},
+        // The VT1000 is unknown, but assumed to be VT320 compatible.
+        {.id = 42, .name = "VT1000", .font_size = soft_font::size_15x12},
+        {.id = 44, .name = "VT382T", .font_size = soft_font::size_12x30},
+        {.id = 61, .name = "VT510", .font_size = soft_font::size_10x16},
+        {.id = 64, .name = "VT520", .font_size = soft_font::size_10x16},
+        {.id = 65, .name = "VT525", .font_size = soft_font::size_10x16},
+        {.id = 66, .name = "VTStar", .font_size = soft_font::size_10x16, .echoes_palette = true, .stalls_after_font = true},
+    });
+
+    // For anything we don't recognise, we assume a 10x16 font, and apply the
+    // workarounds that are cheap enough not to matter if they're not needed.
+    constexpr auto unknown_profile = terminal_profile{
+        .id = 0,
+        .name = "Unknown",
+        .font_size = soft_font::size_10x16,
+        .keeps_double_width = true,
+    };
+
+    static_assert(std::ranges::is_sorted(profiles, {}, &terminal_profile::id));
+
+}  // namespace
+
+const terminal_profile& profile_for_terminal(const int terminal_id)
+{
+    const auto it = std::ranges::lower_bound(profiles, terminal_id, {}, &terminal_profile::id);
+    return it != profiles.end() && it->id == terminal_id ? *it : unknown_profile;
+}
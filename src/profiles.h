@@ -0,0 +1,25 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include "font.h"
+
+// Everything we know about a particular terminal model, identified by the
+// first parameter of its DA2 report. Each quirk is only worked around for
+// the terminals that actually need it.
+struct terminal_profile {
+    int id;
+    const char* name;
+    soft_font::size font_size;
+    // The palette is echoed to the screen rather than applied with DECCTR.
+    bool echoes_palette = false;
+    // A soft font download leaves the terminal stuck until it receives a
+    // flood of SGR sequences.
+    bool stalls_after_font = false;
+    // Double-width lines aren't reset when the screen is cleared.
+    bool keeps_double_width = false;
+};
+
+const terminal_profile& profile_for_terminal(const int terminal_id);
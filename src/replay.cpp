@@ -0,0 +1,118 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#include "replay.h"
+
+#include "options.h"
+#include "snake.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+    // The file starts with a magic number, a version, and the options that
+    // affect the game logic, followed by five bytes for every step: the key,
+    // and the little-endian state hash.
+    constexpr auto magic = std::to_array({'V', 'T', 'N', 'R'});
+    constexpr auto version = char{2};
+
+}  // namespace
+
+replay_recorder::replay_recorder(const std::string& path, const options& options)
+    : _file{path, std::ios::binary}
+{
+    _file.write(magic.data(), magic.size());
+    _file.put(version);
+    _file.put(static_cast<char>(options.grace));
+    _file.put(static_cast<char>(options.wave));
+}
+
+bool replay_recorder::is_open() const
+{
+    return _file.good();
+}
+
+void replay_recorder::record(const key input, const step_result& result)
+{
+    auto bytes = std::array<char, 5>{};
+    bytes[0] = static_cast<char>(input);
+    for (auto i = 0; i < 4; i++)
+        bytes[i + 1] = static_cast<char>(result.checksum >> (i * 8));
+    _file.write(bytes.data(), bytes.size());
+}
+
+replay_player::replay_player(const std::string& path)
+    : _file{path, std::ios::binary}
+{
+    auto header = std::array<char, magic.size() + 3>{};
+    if (_file.read(header.data(), header.size())) {
+        _valid = std::equal(magic.begin(), magic.end(), header.begin()) && header[4] == version;
+        _grace = header[5];
+        _wave = header[6];
+        // The options have to be in the same ranges that the command line
+        // allows, or the file is treated as invalid.
+        _valid = _valid && _grace >= 0 && _grace <= snake::max_grace;
+        _valid = _valid && _wave >= 1 && _wave <= 99;
+    }
+    if (_valid) _read_step();
+}
+
+bool replay_player::is_open() const
+{
+    return _valid;
+}
+
+int replay_player::grace() const
+{
+    return _grace;
+}
+
+int replay_player::wave() const
+{
+    return _wave;
+}
+
+bool replay_player::done() const
+{
+    return !_has_next || _divergence;
+}
+
+key replay_player::next_key()
+{
+    const auto input = _next_key;
+    _expected_checksum = _next_checksum;
+    _steps++;
+    _read_step();
+    return input;
+}
+
+bool replay_player::verify(const step_result& result)
+{
+    if (result.checksum != _expected_checksum && !_divergence)
+        _divergence = _steps;
+    return !_divergence;
+}
+
+int replay_player::steps() const
+{
+    return _steps;
+}
+
+int replay_player::divergence() const
+{
+    return _divergence;
+}
+
+void replay_player::_read_step()
+{
+    auto bytes = std::array<unsigned char, 5>{};
+    _has_next = bool(_file.read(reinterpret_cast<char*>(bytes.data()), bytes.size()));
+    if (_has_next) {
+        _next_key = bytes[0] <= int(key::down) ? static_cast<key>(bytes[0]) : key::none;
+        _next_checksum = 0;
+        for (auto i = 0; i < 4; i++)
+            _next_checksum |= uint32_t{bytes[i + 1]} << (i * 8);
+    }
+}
@@ -0,0 +1,53 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include "game.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+class options;
+
+// The game logic is deterministic, so a session can be reproduced from the
+// key that was fed into each step. Every step is saved along with a hash of
+// the resulting state, so when it's replayed, we can detect any divergence.
+class replay_recorder {
+public:
+    replay_recorder(const std::string& path, const options& options);
+    bool is_open() const;
+    void record(const key input, const step_result& result);
+
+private:
+    std::ofstream _file;
+};
+
+class replay_player {
+public:
+    replay_player(const std::string& path);
+    bool is_open() const;
+    int grace() const;
+    int wave() const;
+    bool done() const;
+    key next_key();
+    bool verify(const step_result& result);
+    int steps() const;
+    int divergence() const;
+
+private:
+    void _read_step();
+
+    std::ifstream _file;
+    bool _valid = false;
+    int _grace = 0;
+    int _wave = 1;
+    key _next_key = key::none;
+    uint32_t _next_checksum = 0;
+    bool _has_next = false;
+    uint32_t _expected_checksum = 0;
+    int _steps = 0;
+    int _divergence = 0;
+};
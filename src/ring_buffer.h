@@ -0,0 +1,86 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+// A fixed-capacity double-ended queue. Pushing and popping at either end is
+// O(1), and since the storage is inline, nothing is ever allocated. The
+// capacity must be a power of two so indices can wrap with a simple mask.
+template <typename T, size_t Capacity>
+class ring_buffer {
+public:
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+    void clear()
+    {
+        _start = 0;
+        _size = 0;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    void push_back(const T& value)
+    {
+        _items[(_start + _size++) & mask] = value;
+    }
+
+    void pop_back()
+    {
+        _size--;
+    }
+
+    void pop_front()
+    {
+        _start = (_start + 1) & mask;
+        _size--;
+    }
+
+    T& front()
+    {
+        return _items[_start];
+    }
+
+    const T& front() const
+    {
+        return _items[_start];
+    }
+
+    T& back()
+    {
+        return _items[(_start + _size - 1) & mask];
+    }
+
+    const T& back() const
+    {
+        return _items[(_start + _size - 1) & mask];
+    }
+
+    T& operator[](const size_t index)
+    {
+        return _items[(_start + index) & mask];
+    }
+
+    const T& operator[](const size_t index) const
+    {
+        return _items[(_start + index) & mask];
+    }
+
+private:
+    static constexpr auto mask = Capacity - 1;
+
+    std::array<T, Capacity> _items = {};
+    size_t _start = 0;
+    size_t _size = 0;
+};
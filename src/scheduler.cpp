@@ -0,0 +1,93 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#include "scheduler.h"
+
+#include "options.h"
+
+#include <algorithm>
+
+using namespace std::chrono_literals;
+
+scheduler::scheduler(const options& options, game_clock& clock)
+    : _clock{clock}, _auto_spin{options.spin < 0}, _max_spin{std::chrono::nanoseconds{1050ms} / options.fps / 8},
+      _spin_time{std::chrono::microseconds{std::max(options.spin, 0)}}
+{
+}
+
+void scheduler::reset()
+{
+    _in_phase = false;
+}
+
+void scheduler::wait(const game_clock::duration interval)
+{
+    // The deadlines are absolute, so the time spent moving the snake and
+    // rendering the frame doesn't accumulate as drift. But if we've fallen
+    // more than a whole frame behind (or we've just come out of an animation
+    // that isn't synced with the frame rate), we start a new phase from now.
+    const auto now = _clock.now();
+    if (!_in_phase) {
+        _deadline = now + interval;
+        _in_phase = true;
+    } else {
+        _deadline += interval;
+        const auto overrun = now > _deadline;
+        if (now - _deadline > interval) {
+            _record(now - _deadline, overrun);
+            _deadline = now;
+            return;
+        } else if (overrun) {
+            _record(now - _deadline, overrun);
+            return;
+        }
+    }
+    const auto oversleep = _clock.sleep_until(_deadline, _spin_time);
+    _record(_clock.now() - _deadline, false);
+    if (_auto_spin) _adjust_spin(oversleep);
+}
+
+void scheduler::report(std::ostream& out) const
+{
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    if (_frames == 0) return;
+    const auto mean_jitter = duration_cast<microseconds>(_total_jitter / _frames).count();
+    const auto max_jitter = duration_cast<microseconds>(_max_jitter).count();
+    out << "Frames: " << _frames << "\n";
+    out << "Overruns: " << _overruns << "\n";
+    out << "Jitter: " << mean_jitter << "us mean, " << max_jitter << "us max\n";
+    if (_auto_spin) out << "Spin: " << duration_cast<microseconds>(_spin_time).count() << "us\n";
+    for (auto i = 0; i < _jitter_buckets.size(); i++) {
+        if (i < bucket_limits.size())
+            out << "  < " << bucket_limits[i] << "us: ";
+        else
+            out << "  >= " << bucket_limits.back() << "us: ";
+        out << _jitter_buckets[i] << "\n";
+    }
+}
+
+void scheduler::_record(const game_clock::duration lateness, const bool overrun)
+{
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(lateness).count();
+    auto bucket = 0;
+    while (bucket < bucket_limits.size() && us >= bucket_limits[bucket])
+        bucket++;
+    _jitter_buckets[bucket]++;
+    _total_jitter += lateness;
+    _max_jitter = std::max(_max_jitter, lateness);
+    _frames++;
+    _overruns += overrun;
+}
+
+void scheduler::_adjust_spin(const game_clock::duration oversleep)
+{
+    // We track the recent peak of the OS wakeup jitter, letting it decay
+    // slowly so one bad wakeup doesn't keep us spinning for long. The spin
+    // covers that peak, but never more than an eighth of a frame (using the
+    // game's stretched second), so the CPU is mostly idle even at the
+    // highest frame rates.
+    _wakeup_jitter = std::max(oversleep, _wakeup_jitter - _wakeup_jitter / 16);
+    _spin_time = std::min(_wakeup_jitter + _wakeup_jitter / 4, _max_spin);
+}
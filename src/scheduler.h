@@ -0,0 +1,39 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include "clock.h"
+
+#include <array>
+#include <ostream>
+
+class options;
+
+class scheduler {
+public:
+    scheduler(const options& options, game_clock& clock);
+    void reset();
+    void wait(const game_clock::duration interval);
+    void report(std::ostream& out) const;
+
+private:
+    void _record(const game_clock::duration lateness, const bool overrun);
+    void _adjust_spin(const game_clock::duration oversleep);
+
+    static constexpr auto bucket_limits = std::to_array<int>({50, 100, 250, 500, 1000, 2000, 5000, 10000});
+
+    game_clock& _clock;
+    const bool _auto_spin;
+    const game_clock::duration _max_spin;
+    game_clock::duration _spin_time;
+    game_clock::duration _wakeup_jitter = {};
+    game_clock::time_point _deadline;
+    bool _in_phase = false;
+    std::array<int, bucket_limits.size() + 1> _jitter_buckets = {};
+    game_clock::duration _total_jitter = {};
+    game_clock::duration _max_jitter = {};
+    int _frames = 0;
+    int _overruns = 0;
+};
@@ -5,28 +5,178 @@
 #include "screen.h"
 
 #include "capabilities.h"
-#include "engine.h"
+#include "game.h"
 #include "options.h"
-#include "os.h"
+#include "profiles.h"
+#include "sequences.h"
+#include "sink.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+
+namespace {
+
+    constexpr auto ri_sequence = make_sequence("\033M");
+    constexpr auto dcs_sequence = make_sequence("\033P");
+    constexpr auto csi_sequence = make_sequence("\033[");
+    constexpr auto st_sequence = make_sequence("\033\\");
+    constexpr auto cpr_sequence = make_sequence("\033[6n");
+    constexpr auto clear_screen_sequence = make_sequence("\033[999;999H\033[1J");
+    constexpr auto clear_line_sequence = make_sequence("\033[K");
+    constexpr auto clear_macros_sequence = make_sequence("\033P0;1;0!z\033\\");
+
+    // DECINVM sequences for every macro id the terminal allows.
+    constexpr auto macro_invocations = []() {
+        auto invocations = std::array<control_sequence<8>, 64>{};
+        for (auto id = 0; id < 64; id++)
+            invocations[id] = make_sequence<8>("\033[", id, "*z");
+        return invocations;
+    }();
+
+    constexpr int digit_count(const int n)
+    {
+        return n < 10 ? 1 : 1 + digit_count(n / 10);
+    }
+
+    // The attributes that our SGR sequences control. A foreground of zero is
+    // the terminal default, which is what we use for white.
+    struct rendition {
+        bool bold = false;
+        bool blink = false;
+        int foreground = 0;
+    };
+
+    // A complete SGR sequence, short enough to be copied in one go.
+    struct sgr_sequence {
+        std::array<char, 15> bytes = {};
+        uint8_t length = 0;
+
+        std::string_view view() const
+        {
+            return {bytes.data(), length};
+        }
+    };
+
+    using sgr_table = std::array<std::array<sgr_sequence, 16>, 16>;
 
-#include <iostream>
+    sgr_sequence sgr_transition(const std::string_view csi, const rendition* from, const rendition& to)
+    {
+        // A reset followed by everything the new rendition needs will always
+        // work, but if we know the current state, we can often get there with
+        // fewer bytes by just changing the attributes that are different.
+        auto reset = std::string{};
+        const auto add_reset = [&](const auto parameter) {
+            reset += ';';
+            reset += parameter;
+        };
+        if (to.bold) add_reset("1");
+        if (to.blink) add_reset("5");
+        if (to.foreground) add_reset(std::to_string(to.foreground));
+        auto parameters = reset;
+        if (from) {
+            auto changes = std::string{};
+            const auto add_change = [&](const auto parameter) {
+                if (!changes.empty()) changes += ';';
+                changes += parameter;
+            };
+            if (from->bold != to.bold) add_change(to.bold ? "1" : "22");
+            if (from->blink != to.blink) add_change(to.blink ? "5" : "25");
+            if (from->foreground != to.foreground)
+                add_change(to.foreground ? std::to_string(to.foreground) : "39");
+            if (changes.empty()) return sgr_sequence{};
+            if (changes.size() < reset.size()) parameters = changes;
+        }
+        auto sequence = sgr_sequence{};
+        const auto add_bytes = [&](const std::string_view bytes) {
+            std::copy(bytes.begin(), bytes.end(), &sequence.bytes[sequence.length]);
+            sequence.length += bytes.size();
+        };
+        add_bytes(csi);
+        add_bytes(parameters);
+        add_bytes("m");
+        return sequence;
+    }
+
+    template <screen_profile Profile>
+    class screen_encoder final : public screen {
+    public:
+        screen_encoder(const capabilities& caps, const options& options, render_sink& sink);
+        using screen::write;
+        void reset() override;
+        void clear_line(const int y) override;
+        void write(const std::string_view s) override;
+        void write(const int y, const int x, const char c, const color color) override;
+        void write(const int y, const int x, const std::string_view s, const color color) override;
+        void fill_color(const int top, const int left, const int bottom, const int right, const color color) override;
+        void set_palette(const color color, const std::string_view rgb) override;
+        void play_sound(const int pitch) override;
+        void wait_for_terminal() override;
+        void probe_terminal() override;
+        int request_checksum(const int id, const int top, const int left, const int bottom, const int right) override;
+        int repaint(const int y, const int x) override;
+        void move_cursor(const int y, const int x) override;
+        void set_color(const color color) override;
+
+    private:
+        static constexpr auto _ri = ri_sequence.view(Profile.eight_bit);
+        static constexpr auto _dcs = dcs_sequence.view(Profile.eight_bit);
+        static constexpr auto _csi = csi_sequence.view(Profile.eight_bit);
+        static constexpr auto _st = st_sequence.view(Profile.eight_bit);
+
+        std::string _define_macro(const int id, const std::string_view content) override;
+        void _sgr(const color color);
+        void _cup(const int y, const int x);
+        void _move_y_relative(const int diff_y);
+        void _move_x_relative(const int diff_y);
+        int _y_relative_cost(const int diff_y) const;
+        int _x_relative_cost(const int diff_x) const;
+        void _write_text(const std::string_view s);
+        void _clear_macros();
+        void _build_sgr_table();
+
+        std::array<color, 16> _color_map = {};
+        std::array<uint8_t, 16> _attribute_bits = {};
+        sgr_table _sgr_table = {};
+    };
+
+    using screen_factory = std::unique_ptr<screen> (*)(const capabilities&, const options&, render_sink&);
+
+    template <screen_profile Profile>
+    std::unique_ptr<screen> make_screen(const capabilities& caps, const options& options, render_sink& sink)
+    {
+        return std::make_unique<screen_encoder<Profile>>(caps, options, sink);
+    }
 
-using namespace std::chrono_literals;
+}  // namespace
 
-screen::screen(const capabilities& caps, const options& options)
-    : _caps{caps}, _using_colors{options.color && caps.has_color},
-      _using_sound{options.sound && caps.has_macros},
-      _blink_allowed{options.blink}, _fps{options.fps},
-      _keyboard_thread{&screen::_key_reader, this}
+std::unique_ptr<screen> screen::create(const capabilities& caps, const options& options, render_sink& sink)
 {
-    _ri = caps.has_8bit ? "\215" : "\033M";
-    _dcs = caps.has_8bit ? "\220" : "\033P";
-    _csi = caps.has_8bit ? "\233" : "\033[";
-    _st = caps.has_8bit ? "\234" : "\033\\";
-    _y_indent = std::max((caps.height - engine::height) / 2, 0);
-    _x_indent = std::max((caps.width - engine::width) / 4 * 2, 0);
-    _clear_macros();
-    reset();
+    // We pick the encoder for this terminal once, up front, and everything
+    // after that goes straight to the specialized code.
+    static constexpr auto factories = std::to_array<screen_factory>({
+        &make_screen<screen_profile{false, false, false}>,
+        &make_screen<screen_profile{false, false, true}>,
+        &make_screen<screen_profile{false, true, false}>,
+        &make_screen<screen_profile{false, true, true}>,
+        &make_screen<screen_profile{true, false, false}>,
+        &make_screen<screen_profile{true, false, true}>,
+        &make_screen<screen_profile{true, true, false}>,
+        &make_screen<screen_profile{true, true, true}>,
+    });
+    const auto using_colors = options.color && caps.has_color;
+    const auto index = using_colors * 4 + caps.has_8bit * 2 + caps.has_macros;
+    return factories[index](caps, options, sink);
+}
+
+screen::screen(const capabilities& caps, const options& options, render_sink& sink)
+    : _caps{caps}, _sink{sink}, _profile{profile_for_terminal(caps.terminal_id)}, _using_sound{options.sound && caps.has_macros}, _using_rep{caps.has_rep},
+      _using_colors{options.color && caps.has_color}, _blink_allowed{options.blink}, _fps{options.fps}
+{
+    _y_indent = std::max((caps.height - game::height) / 2, 0);
+    _x_indent = std::max((caps.width - game::width) / 4 * 2, 0);
+    _cells.resize(game::height * game::width);
+    _shown_cells.resize(_cells.size());
 }
 
 bool screen::blink_allowed() const
@@ -34,196 +184,321 @@ bool screen::blink_allowed() const
     return _blink_allowed;
 }
 
-void screen::reset()
+void screen::write(const char c)
+{
+    _record(c);
+    _write(c);
+    _last_x++;
+}
+
+void screen::set_charset(const std::string_view id)
+{
+    _ascii = id == "B";
+    _write("\033(", id);
+}
+
+void screen::flush()
+{
+    if (_held) {
+        _buffer_index = 0;
+        _palette_end = -1;
+    } else if (_buffer_index) {
+        _sink.write({&_buffer[0], static_cast<size_t>(_buffer_index)});
+        _buffer_index = 0;
+        _palette_end = -1;
+    }
+}
+
+bool screen::probe_pending() const
+{
+    return _sink.probes_pending() > 0;
+}
+
+void screen::hold_output()
+{
+    // While output is held, the drawing still updates the screen model, but
+    // nothing is sent. We keep a copy of what the terminal was last shown,
+    // so we can work out what has changed when the output is released.
+    if (_held) return;
+    flush();
+    _shown_cells = _cells;
+    _shown_y = _last_y;
+    _shown_x = _last_x;
+    _shown_color = _last_color;
+    _shown_ascii = _ascii;
+    _held = true;
+}
+
+void screen::release_output()
+{
+    // Everything that happened in the meantime is reduced to a repaint of
+    // the cells that differ from what the terminal was last shown. Sounds
+    // are dropped, and the blinking palette resyncs on its next tick.
+    if (!_held) return;
+    flush();
+    _held = false;
+    _last_y = _shown_y;
+    _last_x = _shown_x;
+    _last_color = _shown_color;
+    _ascii = _shown_ascii;
+    for (auto y = 1; y <= game::height; y++) {
+        for (auto x = 1; x <= game::width; x++) {
+            const auto i = (y - 1) * game::width + (x - 1);
+            if (_cells[i] == _shown_cells[i]) continue;
+            // A repaint needs at most a cursor move, an SGR sequence, and
+            // a character, so this keeps the buffer from overflowing.
+            if (_buffer_index > _buffer.size() - 64) flush();
+            repaint(y, x);
+        }
+    }
+    flush();
+}
+
+bool screen::output_held() const
+{
+    return _held;
+}
+
+void screen::invoke_macro(const std::string_view macro)
+{
+    _write(macro);
+}
+
+void screen::write_number(const int n)
+{
+    // This is only meaningful as a sequence parameter, so it doesn't move
+    // the cursor or touch the screen model.
+    _write(n);
+}
+
+const screen_cell& screen::cell(const int y, const int x) const
+{
+    return _cells[(y - 1) * game::width + (x - 1)];
+}
+
+screen_snapshot screen::snapshot() const
+{
+    // While output is held, the terminal is still showing what it was shown
+    // before, so that's what the snapshot has to describe.
+    if (_held)
+        return {_y_indent, _x_indent, _shown_y, _shown_x, _shown_color, _using_colors, _shown_ascii, _shown_cells.data()};
+    return {_y_indent, _x_indent, _last_y, _last_x, _last_color, _using_colors, _ascii, _cells.data()};
+}
+
+void screen::_write()
+{
+}
+
+template <typename... Args>
+void screen::_write(const int n, Args... args)
+{
+    const auto end = std::to_chars(&_buffer[_buffer_index], _buffer.data() + _buffer.size(), n).ptr;
+    _buffer_index = static_cast<int>(end - _buffer.data());
+    _write(args...);
+}
+
+template <typename... Args>
+void screen::_write(const std::string_view s, Args... args)
+{
+    std::copy(s.begin(), s.end(), &_buffer[_buffer_index]);
+    _buffer_index += s.size();
+    _write(args...);
+}
+
+template <typename... Args>
+void screen::_write(const char c, Args... args)
+{
+    _buffer[_buffer_index++] = c;
+    _write(args...);
+}
+
+void screen::_record(const char c, const int count)
+{
+    for (auto i = 0; i < count; i++) {
+        if (const auto cell = _model_cell(_last_y, _last_x + i))
+            *cell = {c, _draw_attributes, _draw_color, _ascii};
+    }
+}
+
+void screen::_erase_cells(const int top, const int left, const int bottom, const int right)
+{
+    for (auto y = top; y <= bottom; y++) {
+        for (auto x = left; x <= right; x++)
+            _cells[(y - 1) * game::width + (x - 1)] = {};
+    }
+}
+
+screen_cell* screen::_model_cell(const int abs_y, const int abs_x)
+{
+    const auto y = abs_y - _y_indent;
+    const auto x = abs_x - _x_indent;
+    if (y < 1 || y > game::height || x < 1 || x > game::width) return nullptr;
+    return &_cells[(y - 1) * game::width + (x - 1)];
+}
+
+template <screen_profile Profile>
+screen_encoder<Profile>::screen_encoder(const capabilities& caps, const options& options, render_sink& sink)
+    : screen{caps, options, sink}
+{
+    _build_sgr_table();
+    _clear_macros();
+    reset();
+}
+
+template <screen_profile Profile>
+void screen_encoder<Profile>::reset()
 {
     _last_y = -1;
     _last_x = -1;
     _last_color = color::unknown;
     _sgr(color::white);
-    _write(_csi, "999;999H");
-    _write(_csi, "1J");
+    _write(clear_screen_sequence.view(Profile.eight_bit));
+    _erase_cells(1, 1, game::height, game::width);
     wait_for_terminal();
 }
 
-void screen::clear_line(const int y)
+template <screen_profile Profile>
+void screen_encoder<Profile>::clear_line(const int y)
 {
     _cup(y, 1);
-    _write(_csi, 'K');
+    _write(clear_line_sequence.view(Profile.eight_bit));
+    _erase_cells(y, 1, y, game::width);
 }
 
-void screen::write(const char c)
+template <screen_profile Profile>
+void screen_encoder<Profile>::write(const std::string_view s)
 {
-    _write(c);
-    _last_x++;
-}
-
-void screen::write(const std::string_view s)
-{
-    for (auto c : s)
-        write(c);
+    _write_text(s);
 }
 
-void screen::write(const int y, const int x, const char c, const color color)
+template <screen_profile Profile>
+void screen_encoder<Profile>::write(const int y, const int x, const char c, const color color)
 {
     _sgr(color);
     _cup(y, x);
+    _record(c);
     _write(c);
     _last_x++;
 }
 
-void screen::write(const int y, const int x, const std::string_view s, const color color)
+template <screen_profile Profile>
+void screen_encoder<Profile>::write(const int y, const int x, const std::string_view s, const color color)
 {
     _sgr(color);
     _cup(y, x);
-    for (auto c : s) {
-        _write(c);
-        _last_x++;
-    }
+    _write_text(s);
 }
 
-void screen::fill_color(const int top, const int left, const int bottom, const int right, const color color)
+template <screen_profile Profile>
+void screen_encoder<Profile>::fill_color(const int top, const int left, const int bottom, const int right, const color color)
 {
-    if (_using_colors && _caps.has_rectangle_ops) {
+    if (Profile.color && _caps.has_rectangle_ops) {
         const auto abs_top = top + _y_indent;
         const auto abs_left = left + _x_indent;
         const auto abs_bottom = bottom + _y_indent;
         const auto abs_right = right + _x_indent;
         const auto attrs = 30 + (int(color) & 7);
         _write(_csi, abs_top, ';', abs_left, ';', abs_bottom, ';', abs_right, ";0;", attrs, "$r");
+        // DECCARA resets the other attributes, so the cells lose any bold.
+        for (auto y = top; y <= bottom; y++) {
+            for (auto x = left; x <= right; x++) {
+                auto& cell = _cells[(y - 1) * game::width + (x - 1)];
+                cell.color = ::color(int(color) & 7);
+                cell.attributes = 0;
+            }
+        }
     }
 }
 
-void screen::set_palette(const color color, const std::string_view rgb)
-{
-    // VTStar can't handle DECCTR and will echo the palette to the screen, so
-    // even though it supports color, which shouldn't attempt palette changes.
-    if (_using_colors && _caps.terminal_id != 66)
-        _write(_dcs, "2$p", int(color), ";2;", rgb, _st);
-}
-
-void screen::set_charset(const std::string_view id)
-{
-    _write("\033(", id);
+template <screen_profile Profile>
+void screen_encoder<Profile>::set_palette(const color color, const std::string_view rgb)
+{
+    // Some terminals (like VTStar) can't handle DECCTR and will echo the
+    // palette to the screen, so even though they support color, we shouldn't
+    // attempt palette changes.
+    if (Profile.color && !_profile.echoes_palette) {
+        // If the last thing we wrote was a palette update, this entry can be
+        // added to the end of the same DECCTR instead of starting a new one.
+        if (_palette_end == _buffer_index) {
+            _buffer_index -= _st.size();
+            _write('/', int(color), ";2;", rgb, _st);
+        } else
+            _write(_dcs, "2$p", int(color), ";2;", rgb, _st);
+        _palette_end = _buffer_index;
+    }
 }
 
-void screen::play_sound(const int pitch)
+template <screen_profile Profile>
+void screen_encoder<Profile>::play_sound(const int pitch)
 {
     if (_using_sound)
         _write(_csi, "4;1;", pitch, ",~");
 }
 
-void screen::pause(const std::chrono::milliseconds milliseconds)
+template <screen_profile Profile>
+void screen_encoder<Profile>::wait_for_terminal()
 {
     flush();
-    if (!_exit_requested)
-        std::this_thread::sleep_for(milliseconds);
+    _sink.sync(cpr_sequence.view(Profile.eight_bit));
 }
 
-void screen::flush()
+template <screen_profile Profile>
+void screen_encoder<Profile>::probe_terminal()
 {
-    if (_buffer_index) {
-        if (!_exit_requested) {
-            std::cout.write(&_buffer[0], _buffer_index);
-            std::cout.flush();
-        }
-        _buffer_index = 0;
-    }
-}
-
-void screen::shutdown_keyboard()
-{
-    _keyboard_shutdown = true;
-    _keyboard_thread.join();
-}
-
-void screen::wait_for_terminal()
-{
-    auto lock = std::unique_lock{_cpr_mutex};
-    if (!_exit_requested) {
-        _cpr_received = false;
-        _write(_csi, "6n");
-        flush();
-        // max_used = 0;
-        _cpr_condition.wait(lock, [this] { return _cpr_received; });
-    }
+    flush();
+    _sink.probe(cpr_sequence.view(Profile.eight_bit));
 }
 
-void screen::reset_keys()
+template <screen_profile Profile>
+int screen_encoder<Profile>::request_checksum(const int id, const int top, const int left, const int bottom, const int right)
 {
-    _key_pressed = key::none;
+    const auto start_index = _buffer_index;
+    _write(_csi, id, ";1;", top + _y_indent, ';', left + _x_indent, ';');
+    _write(bottom + _y_indent, ';', right + _x_indent, "*y");
+    return _buffer_index - start_index;
 }
 
-key screen::key_pressed() const
+template <screen_profile Profile>
+int screen_encoder<Profile>::repaint(const int y, const int x)
 {
-    return _key_pressed;
+    // Cells that were drawn with a different character set from the current
+    // one are left alone, since they're only ever used for brief messages.
+    const auto start_index = _buffer_index;
+    const auto repair = cell(y, x);
+    if (repair.ch == 0) {
+        _cup(y, x);
+        _write(_csi, 'X');
+    } else if (repair.ascii == _ascii)
+        write(y, x, repair.ch, repair.color);
+    return _buffer_index - start_index;
 }
 
-bool screen::exit_requested() const
+template <screen_profile Profile>
+void screen_encoder<Profile>::move_cursor(const int y, const int x)
 {
-    return _exit_requested;
+    _cup(y, x);
 }
 
-void screen::invoke_macro(const std::string macro)
+template <screen_profile Profile>
+void screen_encoder<Profile>::set_color(const color color)
 {
-    _write(macro.c_str());
+    _sgr(color);
 }
 
-void screen::_sgr(const color color)
+template <screen_profile Profile>
+void screen_encoder<Profile>::_sgr(const color color)
 {
-    if (!_using_colors) {
-        auto mono_color = color::mono_normal;
-        if (color == color::wall)
-            mono_color = color::mono_bright;
-        if ((color == color::crouton_1 || color == color::crouton_2) && _blink_allowed)
-            mono_color = color::mono_blinking;
-        if (mono_color != _last_color) {
-            _last_color = mono_color;
-            switch (mono_color) {
-                case color::mono_normal:
-                    _write(_csi, "m");
-                    break;
-                case color::mono_blinking:
-                    _write(_csi, "0;5m");
-                    break;
-                case color::mono_bright:
-                    _write(_csi, "0;1m");
-                    break;
-            }
-        }
-    } else if (color != _last_color) {
-        const auto bright = int(color) > 7;
-        const auto last_bright = int(_last_color) > 7;
-        const auto prefix = bright != last_bright ? (bright ? "1;" : ";") : "";
-        _last_color = color;
-        switch (color) {
-            case color::red:
-            case color::crouton_1:
-                _write(_csi, prefix, "31m");
-                break;
-            case color::yellow:
-                _write(_csi, prefix, "33m");
-                break;
-            case color::blue:
-                _write(_csi, prefix, "34m");
-                break;
-            case color::time:
-            case color::crouton_2:
-                _write(_csi, prefix, "35m");
-                break;
-            case color::cyan:
-                _write(_csi, prefix, "36m");
-                break;
-            case color::white:
-                _write(_csi, 'm');
-                break;
-            case color::wall:
-                _write(_csi, prefix, "37m");
-                break;
-        }
+    _draw_color = color;
+    _draw_attributes = _attribute_bits[int(color)];
+    const auto target = _color_map[int(color)];
+    if (target != _last_color) {
+        _write(_sgr_table[int(_last_color)][int(target)].view());
+        _last_color = target;
     }
 }
 
-void screen::_cup(const int y, const int x)
+template <screen_profile Profile>
+void screen_encoder<Profile>::_cup(const int y, const int x)
 {
     const auto abs_y = y + _y_indent;
     const auto abs_x = x + _x_indent;
@@ -231,7 +506,11 @@ void screen::_cup(const int y, const int x)
     auto diff_y = unknown ? 9999 : abs_y - _last_y;
     auto diff_x = unknown ? 9999 : abs_x - _last_x;
     if (diff_y || diff_x) {
-        if (abs(diff_y) > 2 && abs(diff_x) > 2)
+        // We use whichever form is shorter, but if it's a tie, an absolute
+        // position is the safer choice.
+        const auto absolute_cost = int(_csi.size()) + digit_count(abs_y) + digit_count(abs_x) + 2;
+        const auto relative_cost = _y_relative_cost(diff_y) + _x_relative_cost(diff_x);
+        if (unknown || absolute_cost <= relative_cost)
             _write(_csi, abs_y, ';', abs_x, 'H');
         else {
             _move_y_relative(diff_y);
@@ -242,7 +521,8 @@ void screen::_cup(const int y, const int x)
     }
 }
 
-void screen::_move_y_relative(const int diff_y)
+template <screen_profile Profile>
+void screen_encoder<Profile>::_move_y_relative(const int diff_y)
 {
     if (diff_y == -1)
         _write(_ri);
@@ -258,7 +538,8 @@ void screen::_move_y_relative(const int diff_y)
         _write(_csi, -diff_y, 'A');
 }
 
-void screen::_move_x_relative(const int diff_x)
+template <screen_profile Profile>
+void screen_encoder<Profile>::_move_x_relative(const int diff_x)
 {
     if (diff_x == -1)
         _write('\b');
@@ -272,66 +553,53 @@ void screen::_move_x_relative(const int diff_x)
         _write(_csi, -diff_x, 'D');
 }
 
-void screen::_write()
+template <screen_profile Profile>
+int screen_encoder<Profile>::_y_relative_cost(const int diff_y) const
 {
+    if (diff_y == 0) return 0;
+    if (diff_y == -1 || diff_y == -2) return int(_ri.size()) * -diff_y;
+    if (diff_y == 1 || diff_y == 2) return diff_y;
+    return int(_csi.size()) + digit_count(abs(diff_y)) + 1;
 }
 
-template <typename... Args>
-void screen::_write(const int n, Args... args)
+template <screen_profile Profile>
+int screen_encoder<Profile>::_x_relative_cost(const int diff_x) const
 {
-    _write(std::to_string(n));
-    _write(args...);
+    if (diff_x == 0) return 0;
+    if (diff_x == -1 || diff_x == -2) return -diff_x;
+    if (diff_x == 1) return int(_csi.size()) + 1;
+    return int(_csi.size()) + digit_count(abs(diff_x)) + 1;
 }
 
-template <typename... Args>
-void screen::_write(const std::string_view s, Args... args)
+template <screen_profile Profile>
+void screen_encoder<Profile>::_write_text(const std::string_view s)
 {
-    for (auto c : s)
+    // When the terminal supports REP, a run of the same character can be
+    // sent as a single character followed by a repeat count, but that's only
+    // worth doing if the count is shorter than the repeated characters.
+    for (auto i = size_t{0}; i < s.size();) {
+        const auto c = s[i];
+        auto run = size_t{1};
+        while (i + run < s.size() && s[i + run] == c)
+            run++;
+        _record(c, static_cast<int>(run));
         _write(c);
-    _write(args...);
-}
-
-template <typename... Args>
-void screen::_write(const char c, Args... args)
-{
-    _buffer[_buffer_index++] = c;
-    _write(args...);
-}
-
-void screen::_key_reader()
-{
-    while (!_keyboard_shutdown) {
-        const auto ch = os::getch();
-        if (ch == 'A') {
-            _key_pressed = key::up;
-        } else if (ch == 'B') {
-            _key_pressed = key::down;
-        } else if (ch == 'C') {
-            _key_pressed = key::right;
-        } else if (ch == 'D') {
-            _key_pressed = key::left;
-        } else if (ch == 'R') {
-            _notify_cpr_received();
-            if (_exit_requested) break;
-        } else if (ch == 'Q' || ch == 'q' || ch == 3) {
-            _exit_requested = true;
-            if (_cpr_received) break;
+        const auto repeats = static_cast<int>(run - 1);
+        if (_using_rep && repeats > int(_csi.size()) + digit_count(repeats) + 1)
+            _write(_csi, repeats, 'b');
+        else {
+            for (auto j = 0; j < repeats; j++)
+                _write(c);
         }
+        _last_x += run;
+        i += run;
     }
 }
 
-void screen::_notify_cpr_received()
+template <screen_profile Profile>
+std::string screen_encoder<Profile>::_define_macro(const int id, const std::string_view content)
 {
-    {
-        auto lock = std::lock_guard{_cpr_mutex};
-        _cpr_received = true;
-    }
-    _cpr_condition.notify_one();
-}
-
-std::string screen::_define_macro(const int id, const std::string_view content)
-{
-    if (_caps.has_macros && content.size() > 0) {
+    if (Profile.macros && content.size() > 0) {
         static constexpr auto hex_digits = "0123456789ABCDEF";
         auto hex_content = std::string(content.size() * 2, ' ');
         for (auto i = 0; i < content.size(); i++) {
@@ -339,14 +607,52 @@ std::string screen::_define_macro(const int id, const std::string_view content)
             hex_content[i * 2 + 1] = hex_digits[content[i] & 0x0F];
         }
         _write(_dcs, id, ";0;1!z", hex_content, _st);
-        return _csi + std::to_string(id) + "*z";
+        return std::string{macro_invocations[id].view(Profile.eight_bit)};
     } else {
         return std::string{content};
     }
 }
 
-void screen::_clear_macros()
-{
-    if (_caps.has_macros)
-        _write(_dcs, "0;1;0!z", _st);
+template <screen_profile Profile>
+void screen_encoder<Profile>::_clear_macros()
+{
+    if constexpr (Profile.macros)
+        _write(clear_macros_sequence.view(Profile.eight_bit));
+}
+
+template <screen_profile Profile>
+void screen_encoder<Profile>::_build_sgr_table()
+{
+    // In color mode every color has its own rendition, but in mono mode we
+    // map them down to one of the three monochrome attributes.
+    auto renditions = std::array<rendition, 16>{};
+    for (auto i = 1; i < 16; i++) {
+        const auto index = color(i);
+        if constexpr (Profile.color) {
+            _color_map[i] = index;
+            renditions[i].bold = i > 7;
+            renditions[i].foreground = index == color::white ? 0 : 30 + (i & 7);
+        } else {
+            auto mono_color = color::mono_normal;
+            if (index == color::wall)
+                mono_color = color::mono_bright;
+            if ((index == color::crouton_1 || index == color::crouton_2) && _blink_allowed)
+                mono_color = color::mono_blinking;
+            _color_map[i] = mono_color;
+            // The table itself is indexed by the monochrome attributes.
+            renditions[i].bold = index == color::mono_bright;
+            renditions[i].blink = index == color::mono_blinking;
+        }
+    }
+    for (auto i = 1; i < 16; i++) {
+        const auto& rendition = renditions[int(_color_map[i])];
+        _attribute_bits[i] = (rendition.bold ? 0x80 : 0) | (rendition.blink ? 0x40 : 0);
+    }
+    // The unknown state has no rendition we can rely on, so transitions from
+    // there always start with a reset.
+    for (auto to = 1; to < 16; to++) {
+        _sgr_table[0][to] = sgr_transition(_csi, nullptr, renditions[to]);
+        for (auto from = 1; from < 16; from++)
+            _sgr_table[from][to] = sgr_transition(_csi, &renditions[from], renditions[to]);
+    }
 }
@@ -7,56 +7,95 @@
 #include "coloring.h"
 
 #include <array>
-#include <chrono>
-#include <condition_variable>
-#include <mutex>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <string_view>
-#include <thread>
+#include <vector>
 
 class capabilities;
 class options;
+class render_sink;
+struct terminal_profile;
 
-enum class key {
-    none,
-    left,
-    right,
-    up,
-    down
+// The capabilities that change the bytes we generate. Each combination gets
+// its own encoder, so the drawing code never has to test for them.
+struct screen_profile {
+    bool color;
+    bool eight_bit;
+    bool macros;
+};
+
+// What we last drew in one cell of the game area. A character of zero means
+// the cell has been erased. The attributes are the bits that a terminal adds
+// into a DECRQCRA checksum: 0x80 for bold, 0x40 for blink.
+struct screen_cell {
+    char ch = 0;
+    uint8_t attributes = 0;
+    ::color color = ::color::unknown;
+    bool ascii = false;
+
+    bool operator==(const screen_cell&) const = default;
+};
+
+// Everything needed to reconstruct the terminal's view of the game area,
+// without replaying the output that led up to it. The cells are the whole
+// game area, one row after another. Without colors, the rendition is one of
+// the monochrome attributes rather than a game color.
+struct screen_snapshot {
+    int top;
+    int left;
+    int cursor_y;
+    int cursor_x;
+    color rendition;
+    bool colors;
+    bool ascii;
+    const screen_cell* cells;
 };
 
 class screen {
 public:
-    screen(const capabilities& caps, const options& options);
+    static std::unique_ptr<screen> create(const capabilities& caps, const options& options, render_sink& sink);
+    virtual ~screen() = default;
+    screen(const screen&) = delete;
+    screen& operator=(const screen&) = delete;
     bool blink_allowed() const;
-    void reset();
-    void clear_line(const int y);
+    virtual void reset() = 0;
+    virtual void clear_line(const int y) = 0;
     void write(const char c);
-    void write(const std::string_view s);
-    void write(const int y, const int x, const char c, const color color);
-    void write(const int y, const int x, const std::string_view s, const color color);
-    void fill_color(const int top, const int left, const int bottom, const int right, const color color);
-    void set_palette(const color color, const std::string_view rgb);
+    virtual void write(const std::string_view s) = 0;
+    virtual void write(const int y, const int x, const char c, const color color) = 0;
+    virtual void write(const int y, const int x, const std::string_view s, const color color) = 0;
+    virtual void fill_color(const int top, const int left, const int bottom, const int right, const color color) = 0;
+    virtual void set_palette(const color color, const std::string_view rgb) = 0;
     void set_charset(const std::string_view id);
-    void play_sound(const int pitch);
-    void pause(const std::chrono::milliseconds milliseconds);
+    virtual void play_sound(const int pitch) = 0;
     void flush();
-
-    void shutdown_keyboard();
-    void wait_for_terminal();
-    void reset_keys();
-    key key_pressed() const;
-    bool exit_requested() const;
+    virtual void wait_for_terminal() = 0;
+    virtual void probe_terminal() = 0;
+    bool probe_pending() const;
+    void hold_output();
+    void release_output();
+    bool output_held() const;
 
     template <typename T>
     std::string define_macro(const int id, T&& lambda);
-    void invoke_macro(const std::string macro);
+    void invoke_macro(const std::string_view macro);
 
-private:
-    void _sgr(const color color);
-    void _cup(const int y, const int x);
-    void _move_y_relative(const int diff_y);
-    void _move_x_relative(const int diff_y);
+    // The primitives the drawing is built from. The game doesn't need them
+    // on their own, but the benchmarks measure them in isolation.
+    virtual void move_cursor(const int y, const int x) = 0;
+    virtual void set_color(const color color) = 0;
+    void write_number(const int n);
+
+    const screen_cell& cell(const int y, const int x) const;
+    screen_snapshot snapshot() const;
+    virtual int request_checksum(const int id, const int top, const int left, const int bottom, const int right) = 0;
+    virtual int repaint(const int y, const int x) = 0;
+
+protected:
+    screen(const capabilities& caps, const options& options, render_sink& sink);
+    virtual std::string _define_macro(const int id, const std::string_view content) = 0;
     void _write();
     template <typename... Args>
     void _write(const int n, Args... args);
@@ -64,20 +103,18 @@ private:
     void _write(const std::string_view s, Args... args);
     template <typename... Args>
     void _write(const char c, Args... args);
-    void _key_reader();
-    void _notify_cpr_received();
-    std::string _define_macro(const int id, const std::string_view content);
-    void _clear_macros();
+    void _record(const char c, const int count = 1);
+    void _erase_cells(const int top, const int left, const int bottom, const int right);
+    screen_cell* _model_cell(const int abs_y, const int abs_x);
 
     const capabilities& _caps;
-    const bool _using_colors;
+    render_sink& _sink;
+    const terminal_profile& _profile;
     const bool _using_sound;
+    const bool _using_rep;
+    const bool _using_colors;
     const bool _blink_allowed;
     const int _fps;
-    const char* _ri;
-    const char* _dcs;
-    const char* _csi;
-    const char* _st;
     int _y_indent;
     int _x_indent;
     int _last_y = -1;
@@ -85,22 +122,29 @@ private:
     color _last_color = color::unknown;
     std::array<char, 512> _buffer = {};
     int _buffer_index = 0;
-
-    volatile key _key_pressed = key::none;
-    volatile bool _keyboard_shutdown = false;
-    volatile bool _exit_requested = false;
-    std::thread _keyboard_thread;
-    bool _cpr_received = true;
-    std::condition_variable _cpr_condition;
-    std::mutex _cpr_mutex;
+    int _palette_end = -1;
+    std::vector<screen_cell> _cells;
+    color _draw_color = color::unknown;
+    uint8_t _draw_attributes = 0;
+    bool _ascii = false;
+    bool _held = false;
+    std::vector<screen_cell> _shown_cells;
+    int _shown_y = -1;
+    int _shown_x = -1;
+    color _shown_color = color::unknown;
+    bool _shown_ascii = false;
 };
 
 template <typename T>
 std::string screen::define_macro(const int id, T&& lambda)
 {
+    // The macro body mustn't merge its palette updates into a DECCTR that
+    // was buffered before it, or it would cut that from the buffer as well.
     const auto start_index = _buffer_index;
+    _palette_end = -1;
     lambda();
     const auto length = static_cast<size_t>(_buffer_index - start_index);
     _buffer_index = start_index;
+    _palette_end = -1;
     return _define_macro(id, {&_buffer[start_index], length});
 }
@@ -0,0 +1,76 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <string_view>
+
+// A control sequence held in both its 7-bit and 8-bit forms. It's written
+// with 7-bit escapes, and any ESC Fe pair is converted to the equivalent C1
+// control for the 8-bit form. When the parts are constants, the whole thing
+// can be built at compile time, so sending it is just a copy.
+template <std::size_t Capacity>
+class control_sequence {
+public:
+    constexpr control_sequence& append(const std::string_view text)
+    {
+        for (auto i = std::size_t{0}; i < text.size(); i++) {
+            const auto ch = text[i];
+            const auto next = i + 1 < text.size() ? text[i + 1] : '\0';
+            if (ch == '\033' && next >= '@' && next <= '_') {
+                _push(_7bit, _7bit_length, ch);
+                _push(_7bit, _7bit_length, next);
+                _push(_8bit, _8bit_length, static_cast<char>(next + 0x40));
+                i++;
+            } else {
+                _push(_7bit, _7bit_length, ch);
+                _push(_8bit, _8bit_length, ch);
+            }
+        }
+        return *this;
+    }
+
+    constexpr control_sequence& append(const int n)
+    {
+        auto digits = std::array<char, 10>{};
+        auto count = std::size_t{0};
+        auto value = n < 0 ? -n : n;
+        do {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value);
+        if (n < 0) append("-");
+        while (count)
+            append({&digits[--count], 1});
+        return *this;
+    }
+
+    constexpr std::string_view view(const bool eight_bit) const
+    {
+        return eight_bit ? std::string_view{_8bit.data(), _8bit_length} : std::string_view{_7bit.data(), _7bit_length};
+    }
+
+private:
+    static constexpr void _push(std::array<char, Capacity>& buffer, std::size_t& length, const char ch)
+    {
+        if (length >= Capacity) throw std::length_error("control sequence too long");
+        buffer[length++] = ch;
+    }
+
+    std::array<char, Capacity> _7bit = {};
+    std::array<char, Capacity> _8bit = {};
+    std::size_t _7bit_length = 0;
+    std::size_t _8bit_length = 0;
+};
+
+template <std::size_t Capacity = 32, typename... Parts>
+constexpr auto make_sequence(const Parts... parts)
+{
+    auto sequence = control_sequence<Capacity>{};
+    (sequence.append(parts), ...);
+    return sequence;
+}
@@ -0,0 +1,44 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include <optional>
+#include <string_view>
+
+struct checksum_report {
+    int id = 0;
+    int checksum = 0;
+};
+
+class render_sink {
+public:
+    virtual ~render_sink() = default;
+    // Receives each chunk of output when the screen buffer is flushed.
+    virtual void write(const std::string_view data) = 0;
+    // Sends a request that the terminal is expected to answer, and waits
+    // until it has caught up with all the output that preceded it.
+    virtual void sync(const std::string_view request) = 0;
+    // Sends a request that the terminal is expected to answer, but without
+    // waiting for it. Sinks that can't receive replies just discard it.
+    virtual void probe(const std::string_view request)
+    {
+    }
+    // Returns the number of probes that haven't been answered yet.
+    virtual int probes_pending() const
+    {
+        return 0;
+    }
+    // Marks the start of a new wave, for sinks that keep track of where the
+    // output is going.
+    virtual void begin_wave(const int wave)
+    {
+    }
+    // Returns the latest DECRQCRA report, if one has arrived since the last
+    // call. Sinks that can't receive reports never return anything.
+    virtual std::optional<checksum_report> poll_checksum()
+    {
+        return {};
+    }
+};
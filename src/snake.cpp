@@ -6,6 +6,10 @@
 
 #include "levels.h"
 #include "screen.h"
+#include "state_hash.h"
+
+#include <algorithm>
+#include <bit>
 
 using namespace std::literals;
 
@@ -57,16 +61,16 @@ snake::snake(screen& screen, const level& level)
 {
 }
 
-void snake::init()
+animation snake::init()
 {
     const auto y = 32;
     const auto x = 10;
 
     _body.clear();
     for (auto i = 0; i < 11; i++)
-        _body.emplace_back(y, x + i);
+        _body.push_back({y, x + i});
 
-    std::fill(_occupied.begin(), _occupied.end(), false);
+    _occupied.reset();
 
     auto snake_sprite = std::string{};
     snake_sprite += tail_right_sprites[1].substr(0, 2);
@@ -74,57 +78,62 @@ void snake::init()
     snake_sprite += head_right_sprites[3];
     snake_sprite += ' ';
 
-    const auto slow_render = [&](const std::string_view sprite, const auto color, int pitch) {
-        _render(y, x, "", color);
-        for (auto c : sprite) {
-            _screen.write(c);
+    // Other animations may be running in between our steps, so every
+    // character is written with an explicit position and color.
+    const auto sprites = std::to_array<std::string_view>({grid_sprite, snake_sprite, snake_sprite});
+    const auto colors = std::to_array({color::yellow, color::blue, color::snake});
+    const auto pitches = std::to_array({1, 4, 8});
+    for (auto i = 0; i < sprites.size(); i++) {
+        if (i > 0) co_yield 200ms;
+        auto pitch = pitches[i];
+        for (auto j = 0; j < sprites[i].size(); j++) {
+            _render(y, x + j, sprites[i].substr(j, 1), colors[i]);
             _screen.play_sound(pitch++);
-            _screen.pause(32ms);
+            co_yield 32ms;
         }
-    };
-    slow_render(grid_sprite, color::yellow, 1);
-    _screen.pause(200ms);
-    slow_render(snake_sprite, color::blue, 4);
-    _screen.pause(200ms);
-    slow_render(snake_sprite, color::snake, 8);
+    }
     _screen.wait_for_terminal();
 
     _dy = 0;
     _dx = 1;
     _paused = 0;
     _growing = 0;
-    _just_eaten = false;
     _dead = false;
+    _history_size = 0;
+    _history_index = 0;
 }
 
 void snake::move()
 {
-    _just_eaten = false;
     if (_can_move(_dy, _dx)) {
-        auto& head = _body.back();
+        const auto head = _body.back();
         _dead = _is_occupied(head.y + _dy * 2, head.x + _dx * 2);
         if (_dead) return;
-        _body.emplace_back(head.y + _dy, head.x + _dx);
+        // We keep a snapshot of the state before every move, so a late turn
+        // can be applied retroactively if it arrives within the grace window.
+        _history[_history_index] = {head, _dy, _dx, _paused, _growing, _growing == 0, false};
+        _history_index = (_history_index + 1) % _history.size();
+        _history_size = std::min(_history_size + 1, max_grace);
+        _body.push_back({head.y + _dy, head.x + _dx});
         _render_head();
         if (_growing > 0)
             _growing--;
         else {
             _render_tail();
-            _body.erase(_body.cbegin());
+            _body.pop_front();
             _paused = 0;
         }
         _screen.flush();
     } else if (++_paused == 5) {
+        // If the snake has stalled at a junction with only one way out, other
+        // than reversing, it turns that way by itself.
         static constexpr auto dx = std::to_array({0, 0, -1, 1});
         static constexpr auto dy = std::to_array({-1, 1, 0, 0});
-        auto dir = -1;
-        for (auto i = 0; i < 4; i++) {
-            if (_can_move(dy[i], dx[i])) {
-                dir = (dir < 0 ? i : -1);
-                if (dir < 0) break;
-            }
-        }
-        if (dir >= 0) {
+        const auto& head = _body.back();
+        const auto reverse = _dy ? (_dy < 0 ? 0b0010 : 0b0001) : (_dx < 0 ? 0b1000 : 0b0100);
+        const auto exits = static_cast<unsigned>(_level.exits(head.y, head.x) & ~reverse);
+        if (std::has_single_bit(exits)) {
+            const auto dir = std::countr_zero(exits);
             _dy = dy[dir];
             _dx = dx[dir];
             move();
@@ -143,18 +152,47 @@ bool snake::turn(const int dy, const int dx)
     return false;
 }
 
+int snake::late_turn(const int dy, const int dx, const int grace, const int key_age)
+{
+    // Look back for the most recent junction the head passed through, and if
+    // the turn would have been possible there, we roll back to that point.
+    // Moves in which a crouton was eaten can't be undone, though, since that
+    // would also require the level and status to be rolled back. Only the
+    // junctions that were passed before the key was read are considered, so
+    // a key that was pressed early is never applied retroactively.
+    const auto window = std::min(key_age + grace, _history_size);
+    for (auto moves = 1; moves <= window; moves++) {
+        const auto index = (_history_index + _history.size() - moves) % _history.size();
+        const auto& snapshot = _history[index];
+        if (snapshot.ate) break;
+        const auto& head = snapshot.head;
+        if ((head.y % 2) != 0 || (head.x % 2) != 0) continue;
+        if (moves <= key_age) break;
+        if (dy == snapshot.dy && dx == snapshot.dx) break;
+        if (!_can_move(head, snapshot.dy, snapshot.dx, dy, dx)) break;
+        _rollback(moves);
+        _dy = dy;
+        _dx = dx;
+        return moves;
+    }
+    return 0;
+}
+
 void snake::grow()
 {
     _growing = 3;
-    _just_eaten = true;
+    if (_history_size > 0) {
+        const auto index = (_history_index + _history.size() - 1) % _history.size();
+        _history[index].ate = true;
+    }
 }
 
-bool snake::erase()
+animation snake::erase()
 {
     _screen.set_palette(color::snake, snake_erase_palette[0]);
-    for (auto i = 1; !_screen.exit_requested(); i++) {
+    for (auto i = 1;; i++) {
         if (i < 26) _screen.play_sound(26 - i);
-        _screen.pause(32ms);
+        co_yield 32ms;
         if (_body.empty()) break;
         if (i % 3 == 0 && _screen.blink_allowed()) {
             const auto palette_index = i / 3 % snake_erase_palette.size();
@@ -173,9 +211,8 @@ bool snake::erase()
             else if (tail.y % 2)
                 _render(tail.y + (dy < 0), tail.x, "  ");
         }
-        _body.erase(_body.cbegin());
+        _body.pop_front();
     }
-    return !_screen.exit_requested();
 }
 
 std::tuple<int, int> snake::position() const
@@ -184,27 +221,69 @@ std::tuple<int, int> snake::position() const
     return {head.y, head.x};
 }
 
-bool snake::just_eaten() const
+bool snake::is_dead() const
 {
-    return _just_eaten;
+    return _dead;
 }
 
-bool snake::is_dead() const
+void snake::hash_state(state_hash& hash) const
 {
-    return _dead;
+    hash.add(_body.size());
+    for (auto i = size_t{0}; i < _body.size(); i++) {
+        hash.add(_body[i].y);
+        hash.add(_body[i].x);
+    }
+    hash.add(_dy);
+    hash.add(_dx);
+    hash.add(_paused);
+    hash.add(_growing);
+    hash.add(_dead);
 }
 
 bool snake::_can_move(const int dy, const int dx) const
 {
-    const auto& head = _body.back();
+    return _can_move(_body.back(), _dy, _dx, dy, dx);
+}
+
+bool snake::_can_move(const segment& head, const int heading_dy, const int heading_dx, const int dy, const int dx) const
+{
     const auto next_y = head.y + dy;
     const auto next_x = head.x + dx;
     const auto clear1 = _level.is_path(next_y, next_x);
     const auto clear2 = _level.is_path(next_y + 1, next_x + 1);
-    const auto reversing = dx * _dx < 0 || dy * _dy < 0;
+    const auto reversing = dx * heading_dx < 0 || dy * heading_dy < 0;
     return clear1 && clear2 && !reversing;
 }
 
+void snake::_rollback(const int moves)
+{
+    auto tail_moves = 0;
+    for (auto i = 0; i < moves; i++) {
+        _history_index = (_history_index + _history.size() - 1) % _history.size();
+        _history_size--;
+        const auto& snapshot = _history[_history_index];
+        const auto head = _body.back();
+        _body.pop_back();
+        if (head.y % 2 == 0 && head.x % 2 == 0)
+            _track_occupation(head.y, head.x, false);
+        // The only part of the screen that isn't redrawn when the head is
+        // rendered in its old position is the cell under its leading edge.
+        const auto edge_y = (head.y + (snapshot.dy > 0)) & ~1;
+        const auto edge_x = (head.x + (snapshot.dx > 0)) & ~1;
+        _level.redraw_cell(edge_y, edge_x);
+        _dy = snapshot.dy;
+        _dx = snapshot.dx;
+        _paused = snapshot.paused;
+        _growing = snapshot.growing;
+        tail_moves += snapshot.shrank;
+    }
+    // We don't undo the tail movement, since that would require redrawing
+    // most of the tail sprites. Instead we let the snake regrow the length
+    // that was lost while the replayed moves catch up with the tail.
+    _growing += tail_moves;
+    _render_head();
+}
+
 void snake::_render_head()
 {
     const auto& head = _body.back();
@@ -278,11 +357,11 @@ void snake::_render(const int y, const int x, const std::string_view s, const co
 
 void snake::_track_occupation(const int y, const int x, const bool occupied)
 {
-    _occupied[y / 2 * 17 + x / 2] = occupied;
+    _occupied.set(y / 2, x / 2, occupied);
 }
 
 bool snake::_is_occupied(const int y, const int x) const
 {
     if (y % 2 != 0 || x % 2 != 0) return false;
-    return _occupied[y / 2 * 17 + x / 2];
+    return _occupied.test(y / 2, x / 2);
 }
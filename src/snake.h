@@ -4,27 +4,33 @@
 
 #pragma once
 
+#include "animation.h"
+#include "bitboard.h"
 #include "coloring.h"
+#include "ring_buffer.h"
 
 #include <array>
 #include <string_view>
 #include <tuple>
-#include <vector>
 
 class level;
 class screen;
+class state_hash;
 
 class snake {
 public:
+    static constexpr int max_grace = 3;
+
     snake(screen& screen, const level& level);
-    void init();
+    animation init();
     bool turn(const int dy, const int dx);
+    int late_turn(const int dy, const int dx, const int grace, const int key_age);
     void move();
     void grow();
-    bool erase();
+    animation erase();
     std::tuple<int, int> position() const;
-    bool just_eaten() const;
     bool is_dead() const;
+    void hash_state(state_hash& hash) const;
 
 private:
     struct segment {
@@ -32,7 +38,19 @@ private:
         int x;
     };
 
+    struct snapshot {
+        segment head;
+        int dy;
+        int dx;
+        int paused;
+        int growing;
+        bool shrank;
+        bool ate;
+    };
+
     bool _can_move(const int dy, const int dx) const;
+    bool _can_move(const segment& head, const int heading_dy, const int heading_dx, const int dy, const int dx) const;
+    void _rollback(const int moves);
     void _render_head();
     void _render_tail();
     void _render(const int y, const int x, const std::string_view s, const color color = color::red);
@@ -41,12 +59,16 @@ private:
 
     screen& _screen;
     const level& _level;
-    std::vector<segment> _body;
-    std::array<bool, 17 * 17> _occupied = {};
+    // The snake can't be longer than the number of half-cell positions on
+    // the path network, which is well under 1024 for a 17x17 grid.
+    ring_buffer<segment, 1024> _body;
+    bitboard<17, 17> _occupied;
+    std::array<snapshot, max_grace> _history = {};
+    int _history_size = 0;
+    int _history_index = 0;
     int _dy = 0;
     int _dx = 0;
     int _paused = 0;
     int _growing = 0;
-    bool _just_eaten = false;
     bool _dead = false;
 };
@@ -0,0 +1,29 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include <cstdint>
+
+// An FNV-1a hash of the game state. This isn't meant to be secure, just
+// cheap enough to calculate on every step, so a replay can tell as soon as
+// it has diverged from the original session.
+class state_hash {
+public:
+    constexpr void add(const uint32_t value)
+    {
+        for (auto shift = 0; shift < 32; shift += 8) {
+            _hash ^= (value >> shift) & 0xFF;
+            _hash *= 16777619u;
+        }
+    }
+
+    constexpr uint32_t value() const
+    {
+        return _hash;
+    }
+
+private:
+    uint32_t _hash = 2166136261u;
+};
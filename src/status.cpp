@@ -5,25 +5,16 @@
 #include "status.h"
 
 #include "screen.h"
+#include "state_hash.h"
 
 #include <algorithm>
+#include <array>
+#include <charconv>
 #include <chrono>
-#include <string>
+#include <string_view>
 
 using namespace std::chrono_literals;
 
-namespace {
-
-    std::string format_number(const int n)
-    {
-        auto str = std::to_string(n);
-        for (auto i = 3; str.size() > i; i += 4)
-            str.insert(str.size() - i, "~");
-        return str;
-    }
-
-}  // namespace
-
 int status::_high_score = 50000;
 
 status::status(screen& screen)
@@ -86,7 +77,7 @@ void status::gain_life()
     _lives++;
 }
 
-void status::apply_bonus()
+animation status::apply_bonus()
 {
     for (auto i = 0; _time > 0; i++) {
         const auto bonus = std::min(_time, 40);
@@ -95,7 +86,7 @@ void status::apply_bonus()
         _render_score();
         _render_time();
         if (i % 2 == 0) _screen.play_sound(7);
-        _screen.pause(32ms);
+        co_yield 32ms;
     }
 }
 
@@ -114,37 +105,68 @@ bool status::game_over() const
     return _lives <= 0;
 }
 
+void status::hash_state(state_hash& hash) const
+{
+    hash.add(_score);
+    hash.add(_lives);
+    hash.add(_time);
+    hash.add(_frame);
+}
+
+number_string status::pad_number(const int n, const size_t width)
+{
+    auto digits = std::array<char, 11>{};
+    const auto end = std::to_chars(digits.data(), digits.data() + digits.size(), n).ptr;
+    const auto length = static_cast<size_t>(end - digits.data());
+    const auto padding = width > length ? width - length : 0;
+    auto result = number_string{};
+    std::fill_n(result.chars.begin(), padding, ' ');
+    std::copy_n(digits.begin(), length, result.chars.begin() + padding);
+    result.length = padding + length;
+    return result;
+}
+
+number_string status::format_number(const int n)
+{
+    const auto digits = pad_number(n, 0);
+    auto result = number_string{};
+    for (auto i = size_t{0}; i < digits.length; i++) {
+        if (i > 0 && (digits.length - i) % 3 == 0)
+            result.chars[result.length++] = '~';
+        result.chars[result.length++] = digits.chars[i];
+    }
+    return result;
+}
+
 void status::_render_score()
 {
     const auto score_string = format_number(_score);
-    const auto x = 23 - score_string.length();
-    _screen.write(1, x, score_string, color::white);
+    const auto x = 23 - score_string.length;
+    _screen.write(1, x, score_string.view(), color::white);
 }
 
 void status::_render_high_score()
 {
     const auto score_string = format_number(_high_score);
-    const auto x = 23 - score_string.length();
-    _screen.write(2, x, score_string, color::cyan);
+    const auto x = 23 - score_string.length;
+    _screen.write(2, x, score_string.view(), color::cyan);
 }
 
 void status::_render_lives()
 {
-    auto lives_string = std::to_string(std::clamp(_lives - 1, 0, 99));
-    lives_string.insert(0, 2 - lives_string.length(), ' ');
-    _screen.write(1, 36, lives_string, color::white);
+    const auto lives_string = pad_number(std::clamp(_lives - 1, 0, 99), 2);
+    _screen.write(1, 36, lives_string.view(), color::white);
 }
 
 void status::_render_time()
 {
-    auto time_string = std::to_string(std::max(_time, 0));
-    time_string.insert(0, 3 - time_string.length(), ' ');
-    _screen.write(2, 35, time_string, color::white);
+    const auto time_string = pad_number(std::max(_time, 0), 3);
+    _screen.write(2, 35, time_string.view(), color::white);
 }
 
 void status::_render_wave(const int wave)
 {
-    const auto wave_string = std::to_string(wave);
-    const auto x = 24 - wave_string.length();
-    _screen.write(22, x, wave_string, color::white);
+    const auto wave_string = pad_number(wave, 0);
+    const auto x = 24 - wave_string.length;
+    _screen.write(22, x, wave_string.view(), color::white);
 }
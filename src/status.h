@@ -4,7 +4,26 @@
 
 #pragma once
 
+#include "animation.h"
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+
 class screen;
+class state_hash;
+
+// Numbers are formatted into a small fixed buffer, so the status line can
+// be updated every frame without allocating.
+struct number_string {
+    std::array<char, 16> chars = {};
+    size_t length = 0;
+
+    std::string_view view() const
+    {
+        return {chars.data(), length};
+    }
+};
 
 class status {
 public:
@@ -15,10 +34,14 @@ public:
     void add_points(const int points);
     void lose_life();
     void gain_life();
-    void apply_bonus();
+    animation apply_bonus();
     void reset_time();
     bool out_of_time() const;
     bool game_over() const;
+    void hash_state(state_hash& hash) const;
+
+    static number_string pad_number(const int n, const size_t width);
+    static number_string format_number(const int n);
 
 private:
     void _render_score();
@@ -0,0 +1,169 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#include "terminal.h"
+
+#include "os.h"
+
+#include <array>
+#include <charconv>
+#include <iostream>
+#include <utility>
+
+void terminal::write(const std::string_view data)
+{
+    // Once the user has asked to quit, there's no point in sending any more
+    // game output, but anything after that (e.g. restoring the terminal
+    // state on exit) still needs to go through.
+    if (!_input_active || !_exit_requested) {
+        std::cout.write(data.data(), data.size());
+        std::cout.flush();
+    }
+}
+
+void terminal::sync(const std::string_view request)
+{
+    auto lock = std::unique_lock{_cpr_mutex};
+    if (_input_active && !_exit_requested) {
+        _cpr_received = false;
+        write(request);
+        _cpr_condition.wait(lock, [this] { return _cpr_received; });
+    }
+}
+
+void terminal::probe(const std::string_view request)
+{
+    if (_input_active && !_exit_requested) {
+        _probes_pending++;
+        _probes_sent++;
+        write(request);
+    }
+}
+
+int terminal::probes_pending() const
+{
+    return _probes_pending;
+}
+
+void terminal::start_input()
+{
+    _key_pressed = key::none;
+    _keyboard_shutdown = false;
+    _exit_requested = false;
+    _cpr_received = true;
+    _probes_pending = 0;
+    _probes_sent = 0;
+    _probes_answered = 0;
+    _input_active = true;
+    _keyboard_thread = std::thread{&terminal::_key_reader, this};
+}
+
+void terminal::stop_input()
+{
+    // The keyboard thread won't exit until it has read another key, so when
+    // the game is over, this is effectively waiting for a keypress.
+    _keyboard_shutdown = true;
+    _keyboard_thread.join();
+    _input_active = false;
+}
+
+std::optional<checksum_report> terminal::poll_checksum()
+{
+    const auto report = _checksum_report.exchange(-1);
+    if (report < 0) return {};
+    return checksum_report{report >> 16, report & 0xFFFF};
+}
+
+key terminal::read_key()
+{
+    return _key_pressed.exchange(key::none);
+}
+
+std::chrono::steady_clock::time_point terminal::key_time() const
+{
+    return std::chrono::steady_clock::time_point{std::chrono::steady_clock::duration{_key_time.load()}};
+}
+
+uint32_t terminal::probes_sent() const
+{
+    return _probes_sent;
+}
+
+std::optional<std::chrono::steady_clock::time_point> terminal::probe_answered_at(const uint32_t probe) const
+{
+    if (_probes_answered <= probe) return {};
+    const auto time = _answer_times[probe % _answer_times.size()].load();
+    return std::chrono::steady_clock::time_point{std::chrono::steady_clock::duration{time}};
+}
+
+bool terminal::exit_requested() const
+{
+    return _exit_requested;
+}
+
+void terminal::_key_reader()
+{
+    auto last_ch = 0;
+    auto in_dcs = false;
+    auto dcs = std::array<char, 32>{};
+    auto dcs_length = size_t{0};
+    while (!_keyboard_shutdown) {
+        const auto ch = os::getch();
+        const auto previous_ch = std::exchange(last_ch, ch);
+        if (in_dcs) {
+            // A DECRQCRA report can contain hex digits that look just like
+            // the arrow keys, so everything up to the ST is consumed here.
+            if ((ch & 0xFF) == 0x9C || (previous_ch == '\033' && ch == '\\')) {
+                in_dcs = false;
+                _parse_report({dcs.data(), dcs_length});
+            } else if (ch != '\033' && dcs_length < dcs.size())
+                dcs[dcs_length++] = static_cast<char>(ch);
+        } else if ((ch & 0xFF) == 0x90 || (previous_ch == '\033' && ch == 'P')) {
+            in_dcs = true;
+            dcs_length = 0;
+        } else if (ch >= 'A' && ch <= 'D') {
+            static constexpr auto arrow_keys = std::to_array({key::up, key::down, key::right, key::left});
+            _key_time = std::chrono::steady_clock::now().time_since_epoch().count();
+            _key_pressed = arrow_keys[ch - 'A'];
+        } else if (ch == 'R') {
+            _notify_cpr_received();
+            if (_exit_requested && !_probes_pending) break;
+        } else if (ch == 'Q' || ch == 'q' || ch == 3) {
+            _exit_requested = true;
+            if (_cpr_received && !_probes_pending) break;
+        }
+    }
+}
+
+void terminal::_parse_report(const std::string_view report)
+{
+    // We're expecting a DECRQCRA report in the form: id !~ checksum
+    const auto separator = report.find("!~");
+    if (separator == std::string_view::npos) return;
+    auto id = 0;
+    auto checksum = 0;
+    const auto id_end = report.data() + separator;
+    const auto checksum_end = report.data() + report.size();
+    if (std::from_chars(report.data(), id_end, id).ptr != id_end) return;
+    if (std::from_chars(id_end + 2, checksum_end, checksum, 16).ptr != checksum_end) return;
+    _checksum_report = ((id & 0x7FFF) << 16) | (checksum & 0xFFFF);
+}
+
+void terminal::_notify_cpr_received()
+{
+    {
+        // The reports arrive in the order they were requested, and we never
+        // send a probe while a sync is waiting, so any probes that are still
+        // pending must be the ones being answered first.
+        auto lock = std::lock_guard{_cpr_mutex};
+        if (_probes_pending > 0) {
+            const auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+            _answer_times[_probes_answered % _answer_times.size()] = now;
+            _probes_answered++;
+            _probes_pending--;
+        } else
+            _cpr_received = true;
+    }
+    _cpr_condition.notify_one();
+}
@@ -0,0 +1,57 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include "game.h"
+#include "sink.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+class terminal : public render_sink {
+public:
+    void write(const std::string_view data) override;
+    void sync(const std::string_view request) override;
+    void probe(const std::string_view request) override;
+    int probes_pending() const override;
+    std::optional<checksum_report> poll_checksum() override;
+
+    void start_input();
+    void stop_input();
+    key read_key();
+    std::chrono::steady_clock::time_point key_time() const;
+    uint32_t probes_sent() const;
+    std::optional<std::chrono::steady_clock::time_point> probe_answered_at(const uint32_t probe) const;
+    bool exit_requested() const;
+
+private:
+    void _key_reader();
+    void _notify_cpr_received();
+    void _parse_report(const std::string_view report);
+
+    std::atomic<key> _key_pressed = key::none;
+    std::atomic<int> _checksum_report = -1;
+    std::atomic<int> _probes_pending = 0;
+    // Each probe is numbered in the order it was sent, and we keep the time
+    // the most recent answers arrived, so a caller can find out when its own
+    // probe was answered.
+    uint32_t _probes_sent = 0;
+    std::atomic<uint32_t> _probes_answered = 0;
+    std::array<std::atomic<std::chrono::steady_clock::rep>, 16> _answer_times = {};
+    std::atomic<std::chrono::steady_clock::rep> _key_time = 0;
+    volatile bool _input_active = false;
+    volatile bool _keyboard_shutdown = false;
+    volatile bool _exit_requested = false;
+    std::thread _keyboard_thread;
+    bool _cpr_received = true;
+    std::condition_variable _cpr_condition;
+    std::mutex _cpr_mutex;
+};
@@ -0,0 +1,135 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#include "trace.h"
+
+#include "game.h"
+#include "screen.h"
+
+using namespace std::chrono_literals;
+
+trace_writer::trace_writer(const std::string& path, render_sink& sink)
+    : _file{path, std::ios::binary}, _sink{sink}, _start{std::chrono::steady_clock::now()},
+      _last_keyframe{_start}, _keyframe_interval{1s}
+{
+    _file.write("VTNT", 4);
+    _put(trace_format::version, 4);
+}
+
+trace_writer::~trace_writer()
+{
+    const auto index_offset = static_cast<uint64_t>(_file.tellp());
+    _file.put(trace_format::index_type);
+    _put(_index_size, 4);
+    for (auto i = 0; i < _index_size; i++) {
+        _put(_index[i].offset, 8);
+        _put(_index[i].time_us, 8);
+        _put(_index[i].frame, 4);
+    }
+    _put(index_offset, 8);
+    _file.write("VTNI", 4);
+}
+
+bool trace_writer::is_open() const
+{
+    return _file.good();
+}
+
+void trace_writer::write(const std::string_view data)
+{
+    _record(data);
+    _sink.write(data);
+}
+
+void trace_writer::sync(const std::string_view request)
+{
+    _record(request);
+    _sink.sync(request);
+}
+
+void trace_writer::probe(const std::string_view request)
+{
+    _record(request);
+    _sink.probe(request);
+}
+
+int trace_writer::probes_pending() const
+{
+    return _sink.probes_pending();
+}
+
+std::optional<checksum_report> trace_writer::poll_checksum()
+{
+    return _sink.poll_checksum();
+}
+
+void trace_writer::begin_wave(const int wave)
+{
+    _wave = wave;
+    _sink.begin_wave(wave);
+}
+
+void trace_writer::begin_frame()
+{
+    _frame++;
+}
+
+bool trace_writer::keyframe_due() const
+{
+    return std::chrono::steady_clock::now() - _last_keyframe >= _keyframe_interval;
+}
+
+void trace_writer::keyframe(const screen_snapshot& snapshot)
+{
+    if (_index_size == _index.size()) {
+        for (auto i = 0; i < _index_size / 2; i++)
+            _index[i] = _index[i * 2];
+        _index_size /= 2;
+        _keyframe_interval *= 2;
+    }
+    const auto time_us = _timestamp();
+    _index[_index_size++] = {static_cast<uint64_t>(_file.tellp()), time_us, _frame};
+    _last_keyframe = std::chrono::steady_clock::now();
+
+    _file.put(trace_format::keyframe_type);
+    _put(time_us, 8);
+    _put(_frame, 4);
+    _put(_wave, 2);
+    _put(snapshot.top, 2);
+    _put(snapshot.left, 2);
+    _put(snapshot.cursor_y, 2);
+    _put(snapshot.cursor_x, 2);
+    _put(int(snapshot.rendition), 1);
+    _put(snapshot.colors, 1);
+    _put(snapshot.ascii, 1);
+    _put(game::height, 2);
+    _put(game::width, 2);
+    for (auto i = 0; i < game::height * game::width; i++) {
+        const auto& cell = snapshot.cells[i];
+        const auto bytes = std::to_array<char>({cell.ch, char(cell.attributes), char(cell.color), cell.ascii});
+        _file.write(bytes.data(), bytes.size());
+    }
+}
+
+uint64_t trace_writer::_timestamp() const
+{
+    const auto elapsed = std::chrono::steady_clock::now() - _start;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+void trace_writer::_put(const uint64_t value, const int size)
+{
+    for (auto i = 0; i < size; i++)
+        _file.put(static_cast<char>(value >> (i * 8)));
+}
+
+void trace_writer::_record(const std::string_view data)
+{
+    _file.put(trace_format::chunk_type);
+    _put(_timestamp(), 8);
+    _put(_frame, 4);
+    _put(_wave, 2);
+    _put(data.size(), 4);
+    _file.write(data.data(), data.size());
+}
@@ -0,0 +1,85 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+#pragma once
+
+#include "sink.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+struct screen_snapshot;
+
+// The trace file starts with a header, followed by a sequence of records,
+// each one starting with a type byte. All values are little-endian.
+//
+//   header:    "VTNT" u32:version
+//   chunk:     'C' u64:time_us u32:frame u16:wave u32:length bytes...
+//   keyframe:  'K' u64:time_us u32:frame u16:wave i16:top i16:left
+//              i16:cursor_y i16:cursor_x u8:color u8:colors u8:ascii
+//              u16:height u16:width, then four bytes per cell: ch
+//              attributes color ascii
+//   index:     'I' u32:count, then per keyframe: u64:offset u64:time_us
+//              u32:frame
+//   footer:    u64:index_offset "VTNI"
+//
+// The footer is always the last twelve bytes of the file, so a reader can
+// find the index, and from that the nearest keyframe to any point in time,
+// without having to read through everything that came before it.
+namespace trace_format {
+    constexpr auto version = uint32_t{2};
+    constexpr auto header_size = 8;
+    constexpr auto footer_size = 12;
+    constexpr auto chunk_type = 'C';
+    constexpr auto keyframe_type = 'K';
+    constexpr auto index_type = 'I';
+}  // namespace trace_format
+
+// A sink that passes everything through to another sink, while recording
+// each chunk of output in a trace file, along with when it was written, and
+// which frame and wave it belonged to.
+class trace_writer : public render_sink {
+public:
+    trace_writer(const std::string& path, render_sink& sink);
+    ~trace_writer() override;
+    bool is_open() const;
+
+    void write(const std::string_view data) override;
+    void sync(const std::string_view request) override;
+    void probe(const std::string_view request) override;
+    int probes_pending() const override;
+    std::optional<checksum_report> poll_checksum() override;
+    void begin_wave(const int wave) override;
+
+    void begin_frame();
+    bool keyframe_due() const;
+    void keyframe(const screen_snapshot& snapshot);
+
+private:
+    struct index_entry {
+        uint64_t offset;
+        uint64_t time_us;
+        uint32_t frame;
+    };
+
+    uint64_t _timestamp() const;
+    void _put(const uint64_t value, const int size);
+    void _record(const std::string_view data);
+
+    std::ofstream _file;
+    render_sink& _sink;
+    const std::chrono::steady_clock::time_point _start;
+    std::chrono::steady_clock::time_point _last_keyframe;
+    std::chrono::steady_clock::duration _keyframe_interval;
+    uint32_t _frame = 0;
+    int _wave = 0;
+    // The index has a fixed capacity, so nothing is allocated mid-game. When
+    // it fills up, we drop every other entry, and double the interval.
+    std::array<index_entry, 1024> _index = {};
+    int _index_size = 0;
+};
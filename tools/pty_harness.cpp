@@ -0,0 +1,302 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+// Runs the real game on a pseudo-terminal, with the VT emulator standing in
+// for the terminal. Output is only read as fast as the chosen baud rate would
+// deliver it, so the game sees the same back pressure as it would on a serial
+// line. Turns are sent at intervals, and we measure how long each one takes
+// to become visible, and how far the display trails behind the game.
+
+#include "emulator.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+using namespace std::chrono_literals;
+
+namespace {
+
+    constexpr auto identities = std::to_array<terminal_identity>({
+        {
+            .name = "vt320",
+            .primary_attributes = "\033[?63;1;2;6;7;8c",
+            .secondary_attributes = "\033[>24;10;0c",
+            .tertiary_attributes = "\033P!|00000000\033\\",
+        },
+        {
+            .name = "vt525",
+            .primary_attributes = "\033[?65;1;2;7;8;9;12;18;19;21;22;23;24;42;44;45;46c",
+            .secondary_attributes = "\033[>65;10;0c",
+            .tertiary_attributes = "\033P!|00000000\033\\",
+            .has_color_table = true,
+        },
+        {
+            .name = "wt",
+            .primary_attributes = "\033[?61;4;6;7;14;21;22;23;24;28;32;42c",
+            .secondary_attributes = "\033[>0;10;1c",
+            .tertiary_attributes = "\033P!|00000000\033\\",
+            .accepts_c1 = false,
+            .has_rep = true,
+            .has_color_table = true,
+        },
+    });
+
+    constexpr auto turn_timeout = 3s;
+    constexpr auto backlog_interval = 100ms;
+
+    // Each direction the snake can face has a head sprite that isn't used
+    // anywhere else, so we can tell which way it's going from the screen.
+    enum direction {
+        up = 1,
+        down = 2,
+        left = 4,
+        right = 8,
+    };
+
+    struct head_sprite {
+        direction facing;
+        std::string_view chars;
+        std::string_view key;
+    };
+
+    constexpr auto head_sprites = std::to_array<head_sprite>({
+        {up, "gh&(", "\033[A"},
+        {down, "ef$%", "\033[B"},
+        {right, "ab", "\033[C"},
+        {left, "cd", "\033[D"},
+    });
+
+    int visible_directions(const vt_emulator& terminal)
+    {
+        auto directions = 0;
+        for (const auto& cell : terminal.cells()) {
+            if (cell.ascii || cell.ch == 0) continue;
+            for (const auto& sprite : head_sprites) {
+                if (sprite.chars.find(cell.ch) != std::string_view::npos)
+                    directions |= sprite.facing;
+            }
+        }
+        return directions;
+    }
+
+    struct pending_turn {
+        std::chrono::steady_clock::time_point sent;
+        direction wanted;
+        int visible_before;
+    };
+
+    double percentile(std::vector<double> values, const double fraction)
+    {
+        if (values.empty()) return 0;
+        std::ranges::sort(values);
+        const auto index = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+        return values[index];
+    }
+
+    void write_distribution(const char* name, const std::vector<double>& values, const bool last)
+    {
+        std::printf("  \"%s\": {\"count\": %zu, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}%s\n", name,
+                    values.size(), percentile(values, 0.5), percentile(values, 0.9), percentile(values, 0.99),
+                    percentile(values, 1.0), last ? "" : ",");
+    }
+
+    void write_all(const int fd, std::string_view data)
+    {
+        while (!data.empty()) {
+            const auto written = ::write(fd, data.data(), data.size());
+            if (written <= 0) return;
+            data.remove_prefix(written);
+        }
+    }
+
+    int usage()
+    {
+        std::cerr << "Usage: vtnibbler_pty [--terminal vt320|vt525|wt] [--baud N] [--duration SECONDS]\n"
+                     "                     [--turn-every MS] [--exe PATH] [-- GAME OPTIONS]\n";
+        return 2;
+    }
+
+}  // namespace
+
+int main(const int argc, const char* argv[])
+{
+    auto identity = &identities[1];
+    auto baud = 9600;
+    auto duration = 30.0;
+    auto turn_interval = std::chrono::milliseconds{500};
+    auto exe = std::string{argv[0]};
+    exe = exe.substr(0, exe.find_last_of('/') + 1) + "vtnibbler";
+    auto game_args = std::vector<std::string>{};
+    for (auto i = 1; i < argc; i++) {
+        const auto arg = std::string_view{argv[i]};
+        const auto has_value = i + 1 < argc;
+        if (arg == "--terminal" && has_value) {
+            const auto name = std::string_view{argv[++i]};
+            const auto it = std::ranges::find(identities, name, &terminal_identity::name);
+            if (it == identities.end()) return usage();
+            identity = &*it;
+        } else if ((arg == "--baud" || arg == "--duration" || arg == "--turn-every") && has_value) {
+            try {
+                const auto value = std::string{argv[++i]};
+                if (arg == "--baud")
+                    baud = std::max(std::stoi(value), 0);
+                else if (arg == "--turn-every")
+                    turn_interval = std::chrono::milliseconds{std::max(std::stoi(value), 1)};
+                else {
+                    duration = std::stod(value);
+                    // This also rules out NaN, which fails every comparison.
+                    if (!(duration >= 0 && duration < 1e9)) return usage();
+                }
+            } catch (std::exception) {
+                return usage();
+            }
+        } else if (arg == "--exe" && has_value)
+            exe = argv[++i];
+        else if (arg == "--") {
+            game_args.assign(argv + i + 1, argv + argc);
+            break;
+        } else
+            return usage();
+    }
+
+    auto terminal = vt_emulator{24, 80};
+    terminal.answer_queries(*identity);
+
+    auto size = winsize{};
+    size.ws_row = terminal.height();
+    size.ws_col = terminal.width();
+    auto master = -1;
+    const auto pid = forkpty(&master, nullptr, nullptr, &size);
+    if (pid < 0) {
+        std::perror("vtnibbler_pty: forkpty");
+        return 1;
+    }
+    if (pid == 0) {
+        auto child_argv = std::vector<char*>{exe.data()};
+        for (auto& arg : game_args)
+            child_argv.push_back(arg.data());
+        child_argv.push_back(nullptr);
+        execv(exe.c_str(), child_argv.data());
+        std::perror("vtnibbler_pty: exec");
+        _exit(127);
+    }
+
+    // The line delivers a byte for every ten bits: eight data bits, plus the
+    // start and stop bits. We read about 10ms worth at a time, and then wait
+    // until the line would have finished sending it. An idle line doesn't
+    // build up any credit, so a burst after a pause is still throttled.
+    const auto bytes_per_second = baud / 10.0;
+    const auto read_size = baud ? std::clamp(static_cast<int>(bytes_per_second / 100), 1, 4096) : 4096;
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>{duration});
+    auto consumed = uint64_t{0};
+    auto line_free = start;
+    auto buffer = std::array<char, 4096>{};
+    auto seed = uint32_t{12345};
+    auto pending = std::optional<pending_turn>{};
+    auto next_turn = start;
+    auto next_sample = start;
+    auto latencies = std::vector<double>{};
+    auto backlogs = std::vector<double>{};
+    auto turns_sent = 0;
+    auto turns_not_applied = 0;
+    for (auto now = start; now < end; now = std::chrono::steady_clock::now()) {
+        if (now < line_free) {
+            std::this_thread::sleep_for(1ms);
+            continue;
+        }
+        auto fds = pollfd{master, POLLIN, 0};
+        if (poll(&fds, 1, 5) < 0) break;
+        if (fds.revents & POLLIN) {
+            const auto length = read(master, buffer.data(), read_size);
+            if (length <= 0) break;
+            consumed += length;
+            if (baud) {
+                const auto sending_time = std::chrono::duration<double>{length / bytes_per_second};
+                line_free = std::max(line_free, now) + std::chrono::duration_cast<std::chrono::steady_clock::duration>(sending_time);
+            }
+            terminal.write({buffer.data(), static_cast<size_t>(length)});
+            write_all(master, terminal.take_replies());
+        } else if (fds.revents & (POLLHUP | POLLERR))
+            break;
+
+        if (now >= next_sample) {
+            // Whatever the game has written that we haven't read yet is still
+            // on its way down the line.
+            auto queued = 0;
+            ioctl(master, FIONREAD, &queued);
+            if (baud) backlogs.push_back(queued / bytes_per_second * 1000);
+            next_sample = now + backlog_interval;
+        }
+
+        const auto visible = visible_directions(terminal);
+        if (pending) {
+            if ((visible & pending->wanted) && !(pending->visible_before & pending->wanted)) {
+                latencies.push_back(std::chrono::duration<double, std::milli>{now - pending->sent}.count());
+                pending.reset();
+                next_turn = now + turn_interval;
+            } else if ((visible & ~pending->visible_before) || now - pending->sent > turn_timeout) {
+                // If the snake turned some other way, or never turned at all,
+                // the key was blocked by a wall, or lost when the snake died,
+                // so that's counted separately.
+                turns_not_applied++;
+                pending.reset();
+                next_turn = now + turn_interval;
+            }
+        } else if (visible && now >= next_turn) {
+            // We always turn at right angles to the current heading, since a
+            // reversal is never allowed, and the same direction is a no-op.
+            seed = seed * 1664525u + 1013904223u;
+            const auto vertical = (visible & (up | down)) != 0;
+            const auto choices = vertical ? std::to_array({left, right}) : std::to_array({up, down});
+            auto wanted = choices[(seed >> 16) & 1];
+            if (visible & wanted) wanted = wanted == choices[0] ? choices[1] : choices[0];
+            if (!(visible & wanted)) {
+                const auto sprite = std::ranges::find(head_sprites, wanted, &head_sprite::facing);
+                write_all(master, sprite->key);
+                pending = pending_turn{now, wanted, visible};
+                turns_sent++;
+            }
+        }
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    close(master);
+
+    const auto elapsed = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+    std::printf("{\n");
+    std::printf("  \"terminal\": \"%.*s\",\n", int(identity->name.size()), identity->name.data());
+    std::printf("  \"baud\": %d,\n", baud);
+    std::printf("  \"seconds\": %.1f,\n", elapsed);
+    std::printf("  \"bytes_displayed\": %llu,\n", static_cast<unsigned long long>(consumed));
+    std::printf("  \"bytes_per_second\": %.0f,\n", consumed / elapsed);
+    std::printf("  \"turns_sent\": %d,\n", turns_sent);
+    std::printf("  \"turns_not_applied\": %d,\n", turns_not_applied);
+    write_distribution("turn_latency_ms", latencies, false);
+    write_distribution("display_lag_ms", backlogs, true);
+    std::printf("}\n");
+    return 0;
+}
@@ -0,0 +1,496 @@
+// VT Nibbler
+// Copyright (c) 2024 James Holderness
+// Distributed under the MIT License
+
+// Reads a trace file written with the --trace option, and either summarizes
+// where the bytes went, or exports it as an asciicast for playback.
+
+#include "coloring.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    enum category {
+        text,
+        cursor,
+        rendition,
+        erase,
+        palette,
+        font,
+        macro_definition,
+        macro_invocation,
+        sound,
+        checksum,
+        query,
+        other,
+        category_count
+    };
+
+    constexpr auto category_names = std::to_array<std::string_view>({
+        "text",
+        "cursor",
+        "sgr",
+        "erase",
+        "palette",
+        "font",
+        "macro define",
+        "macro invoke",
+        "sound",
+        "checksum",
+        "query",
+        "other",
+    });
+
+    using category_counts = std::array<uint64_t, category_count>;
+
+    // A minimal parser for the sequences we generate, which works out what
+    // each byte was for. It keeps its state between chunks, since a long
+    // sequence (like a font download) can be split across more than one.
+    class classifier {
+    public:
+        void feed(const unsigned char ch, category_counts& counts)
+        {
+            _length++;
+            switch (_state) {
+                case state::ground:
+                    if (ch == 0x1B)
+                        _state = state::escape;
+                    else if (ch == 0x9B)
+                        _start(state::csi);
+                    else if (ch == 0x90)
+                        _start(state::dcs);
+                    else if (ch == 0x8D || ch == '\b' || ch == '\v')
+                        _finish(cursor, counts);
+                    else
+                        _finish(ch >= 0x20 ? text : other, counts);
+                    break;
+                case state::escape:
+                    if (ch == '[')
+                        _state = state::csi;
+                    else if (ch == 'P')
+                        _state = state::dcs;
+                    else if (ch == 'M')
+                        _finish(cursor, counts);
+                    else if (ch >= 0x20 && ch <= 0x2F)
+                        _state = state::escape_intermediate;
+                    else
+                        _finish(other, counts);
+                    break;
+                case state::escape_intermediate:
+                    if (ch >= 0x30) _finish(other, counts);
+                    break;
+                case state::csi:
+                    if (ch >= 0x20 && ch <= 0x2F)
+                        _intermediate = ch;
+                    else if (ch >= 0x40 && ch <= 0x7E)
+                        _finish(_csi_category(ch), counts);
+                    break;
+                case state::dcs:
+                    if (ch >= 0x20 && ch <= 0x2F)
+                        _intermediate = ch;
+                    else if (ch >= 0x40 && ch <= 0x7E) {
+                        _dcs_category = _dcs_final(ch);
+                        _state = state::dcs_data;
+                    }
+                    break;
+                case state::dcs_data:
+                    if (ch == 0x9C || (_previous == 0x1B && ch == '\\'))
+                        _finish(_dcs_category, counts);
+                    break;
+            }
+            _previous = ch;
+        }
+
+    private:
+        enum class state {
+            ground,
+            escape,
+            escape_intermediate,
+            csi,
+            dcs,
+            dcs_data
+        };
+
+        void _start(const state state)
+        {
+            _state = state;
+            _intermediate = 0;
+        }
+
+        void _finish(const category category, category_counts& counts)
+        {
+            counts[category] += _length;
+            _length = 0;
+            _intermediate = 0;
+            _state = state::ground;
+        }
+
+        category _csi_category(const unsigned char final) const
+        {
+            if (_intermediate == 0) {
+                switch (final) {
+                    case 'A':
+                    case 'B':
+                    case 'C':
+                    case 'D':
+                    case 'H':
+                        return cursor;
+                    case 'm':
+                        return rendition;
+                    case 'J':
+                    case 'K':
+                    case 'X':
+                        return erase;
+                    case 'b':
+                        return text;
+                    case 'c':
+                    case 'n':
+                        return query;
+                }
+            } else if (_intermediate == '*' && final == 'z')
+                return macro_invocation;
+            else if (_intermediate == '*' && final == 'y')
+                return checksum;
+            else if (_intermediate == ',' && final == '~')
+                return sound;
+            else if (_intermediate == '$' && final == 'r')
+                return rendition;
+            return other;
+        }
+
+        category _dcs_final(const unsigned char final) const
+        {
+            if (_intermediate == '$' && final == 'p') return palette;
+            if (_intermediate == '!' && final == 'z') return macro_definition;
+            if (final == '{') return font;
+            return other;
+        }
+
+        state _state = state::ground;
+        unsigned char _intermediate = 0;
+        unsigned char _previous = 0;
+        category _dcs_category = other;
+        uint64_t _length = 0;
+    };
+
+    class trace_reader {
+    public:
+        explicit trace_reader(std::vector<char> data)
+            : _data{std::move(data)}
+        {
+        }
+
+        bool valid() const
+        {
+            if (_data.size() < trace_format::header_size || std::string_view{_data.data(), 4} != "VTNT") return false;
+            return number(4, 4) == trace_format::version;
+        }
+
+        // Uses the index to find the last keyframe at or before the given
+        // time, returning the offset to start reading from.
+        size_t seek(const uint64_t time_us) const
+        {
+            auto offset = size_t{trace_format::header_size};
+            if (_data.size() < trace_format::header_size + trace_format::footer_size) return offset;
+            const auto footer = _data.size() - trace_format::footer_size;
+            if (std::string_view{&_data[footer + 8], 4} != "VTNI") return offset;
+            auto position = static_cast<size_t>(number(footer, 8));
+            if (position >= footer || _data[position] != trace_format::index_type) return offset;
+            const auto count = number(position + 1, 4);
+            position += 5;
+            for (auto i = uint64_t{0}; i < count && position + 20 <= footer; i++, position += 20) {
+                if (number(position + 8, 8) > time_us) break;
+                offset = static_cast<size_t>(number(position, 8));
+            }
+            return offset;
+        }
+
+        uint64_t number(const size_t offset, const int size) const
+        {
+            auto value = uint64_t{0};
+            for (auto i = 0; i < size; i++)
+                value |= uint64_t{static_cast<unsigned char>(_data[offset + i])} << (i * 8);
+            return value;
+        }
+
+        int64_t signed_number(const size_t offset, const int size) const
+        {
+            const auto value = number(offset, size);
+            const auto sign = uint64_t{1} << (size * 8 - 1);
+            return static_cast<int64_t>(value ^ sign) - static_cast<int64_t>(sign);
+        }
+
+        size_t size() const
+        {
+            return _data.size();
+        }
+
+        bool contains(const size_t offset, const size_t length) const
+        {
+            return offset <= _data.size() && length <= _data.size() - offset;
+        }
+
+        // The length of the chunk or keyframe at the given offset, including
+        // its header, or zero if it's some other record, like the index. If
+        // the header itself is cut short, that's all we count.
+        size_t record_length(const size_t offset) const
+        {
+            const auto type = _data[offset];
+            if (type == trace_format::chunk_type) {
+                if (!contains(offset, 19)) return 19;
+                return 19 + number(offset + 15, 4);
+            } else if (type == trace_format::keyframe_type) {
+                if (!contains(offset, 30)) return 30;
+                return 30 + number(offset + 26, 2) * number(offset + 28, 2) * 4;
+            }
+            return 0;
+        }
+
+        char at(const size_t offset) const
+        {
+            return _data[offset];
+        }
+
+        std::string_view view(const size_t offset, const size_t length) const
+        {
+            return {&_data[offset], length};
+        }
+
+    private:
+        std::vector<char> _data;
+    };
+
+    struct wave_stats {
+        uint64_t bytes = 0;
+        uint32_t first_frame = 0;
+        uint32_t last_frame = 0;
+        category_counts categories = {};
+    };
+
+    bool summarize(const trace_reader& trace, size_t offset)
+    {
+        auto waves = std::map<int, wave_stats>{};
+        auto totals = category_counts{};
+        auto parser = classifier{};
+        auto frame_bytes = std::map<uint32_t, uint64_t>{};
+        auto keyframes = 0;
+        auto complete = true;
+        while (offset < trace.size()) {
+            // A session that crashed can leave the last record cut short, so
+            // we summarize everything up to that point.
+            const auto type = trace.at(offset);
+            const auto record_length = trace.record_length(offset);
+            if (record_length == 0) break;
+            if (!trace.contains(offset, record_length)) {
+                complete = false;
+                break;
+            }
+            if (type == trace_format::chunk_type) {
+                const auto frame = static_cast<uint32_t>(trace.number(offset + 9, 4));
+                const auto wave = static_cast<int>(trace.number(offset + 13, 2));
+                const auto length = static_cast<size_t>(trace.number(offset + 15, 4));
+                const auto data = trace.view(offset + 19, length);
+                auto& stats = waves[wave];
+                if (stats.bytes == 0) stats.first_frame = frame;
+                stats.last_frame = frame;
+                stats.bytes += length;
+                frame_bytes[frame] += length;
+                for (const auto ch : data)
+                    parser.feed(static_cast<unsigned char>(ch), stats.categories);
+            } else
+                keyframes++;
+            offset += record_length;
+        }
+
+        auto total_bytes = uint64_t{0};
+        // Anything written before the first wave started, like the soft font
+        // download, is listed as wave zero.
+        std::cout << "wave      bytes   frames  bytes/frame\n";
+        for (const auto& [wave, stats] : waves) {
+            const auto frames = stats.last_frame - stats.first_frame + 1;
+            std::printf("%4d %10llu %8u %12.1f\n", wave, static_cast<unsigned long long>(stats.bytes), frames,
+                        double(stats.bytes) / frames);
+            total_bytes += stats.bytes;
+            for (auto i = 0; i < category_count; i++)
+                totals[i] += stats.categories[i];
+        }
+
+        auto max_frame = uint64_t{0};
+        for (const auto& [frame, bytes] : frame_bytes)
+            max_frame = std::max(max_frame, bytes);
+        std::cout << "\ntotal " << total_bytes << " bytes in " << frame_bytes.size() << " frames with output, ";
+        std::cout << "largest frame " << max_frame << " bytes, " << keyframes << " keyframes\n\n";
+        for (auto i = 0; i < category_count; i++) {
+            if (totals[i] == 0) continue;
+            std::printf("%-14s %10llu %5.1f%%\n", category_names[i].data(), static_cast<unsigned long long>(totals[i]),
+                        100.0 * totals[i] / std::max<uint64_t>(total_bytes, 1));
+        }
+        return complete;
+    }
+
+    // The colors depend on the terminal's palette, so we just use the ANSI
+    // color with the same index, mapped the same way as the screen encoder.
+    std::string sgr_sequence(const bool bold, const bool blink, const int color_index)
+    {
+        auto sequence = std::string{"\033[0"};
+        if (bold) sequence += ";1";
+        if (blink) sequence += ";5";
+        if (color_index && color_index != int(color::white))
+            sequence += ";" + std::to_string(30 + (color_index & 7));
+        return sequence + 'm';
+    }
+
+    std::string charset_sequence(const bool ascii)
+    {
+        // The soft font is designated with the same id the game uses.
+        return ascii ? "\033(B" : "\033( @";
+    }
+
+    std::string json_string(const std::string_view data)
+    {
+        static constexpr auto hex_digits = "0123456789abcdef";
+        auto json = std::string{"\""};
+        for (const auto ch : data) {
+            const auto byte = static_cast<unsigned char>(ch);
+            if (byte == '"' || byte == '\\') {
+                json += '\\';
+                json += ch;
+            } else if (byte >= 0x20 && byte < 0x7F)
+                json += ch;
+            else {
+                json += "\\u00";
+                json += hex_digits[byte >> 4];
+                json += hex_digits[byte & 0x0F];
+            }
+        }
+        return json + '"';
+    }
+
+    bool export_asciicast(const trace_reader& trace, size_t offset)
+    {
+        std::cout << R"({"version": 2, "width": 80, "height": 24})" << "\n";
+        auto start_time = uint64_t{0};
+        auto first = true;
+        while (offset < trace.size()) {
+            const auto type = trace.at(offset);
+            const auto record_length = trace.record_length(offset);
+            if (record_length == 0) break;
+            if (!trace.contains(offset, record_length)) return false;
+            const auto time_us = trace.number(offset + 1, 8);
+            const auto is_first = std::exchange(first, false);
+            if (is_first) start_time = time_us;
+            const auto seconds = double(time_us - start_time) / 1'000'000;
+            if (type == trace_format::chunk_type) {
+                const auto length = static_cast<size_t>(trace.number(offset + 15, 4));
+                std::printf("[%.6f, \"o\", %s]\n", seconds, json_string(trace.view(offset + 19, length)).c_str());
+            } else {
+                const auto top = trace.signed_number(offset + 15, 2);
+                const auto left = trace.signed_number(offset + 17, 2);
+                const auto cursor_y = trace.signed_number(offset + 19, 2);
+                const auto cursor_x = trace.signed_number(offset + 21, 2);
+                const auto rendition = static_cast<int>(trace.number(offset + 23, 1));
+                const auto colors = trace.at(offset + 24) != 0;
+                const auto ascii = trace.at(offset + 25) != 0;
+                const auto height = static_cast<int>(trace.number(offset + 26, 2));
+                const auto width = static_cast<int>(trace.number(offset + 28, 2));
+                // Only the first keyframe is needed to set up the screen. We
+                // reproduce each cell's text, attributes and character set,
+                // and then restore the rendition and character set that were
+                // active, so the chunks that follow carry on from there.
+                if (is_first) {
+                    auto output = std::string{"\033[H\033[2J"};
+                    auto last_sgr = std::string{};
+                    auto last_ascii = true;
+                    for (auto y = 0; y < height; y++) {
+                        output += "\033[" + std::to_string(top + y + 1) + ";" + std::to_string(left + 1) + "H";
+                        for (auto x = 0; x < width; x++) {
+                            const auto cell = offset + 30 + (y * width + x) * 4;
+                            const auto ch = trace.at(cell);
+                            const auto attributes = static_cast<unsigned char>(trace.at(cell + 1));
+                            const auto color_index = colors ? static_cast<int>(trace.number(cell + 2, 1)) : 0;
+                            const auto cell_ascii = trace.at(cell + 3) != 0;
+                            const auto sgr = sgr_sequence(attributes & 0x80, attributes & 0x40, color_index);
+                            if (sgr != last_sgr) {
+                                output += sgr;
+                                last_sgr = sgr;
+                            }
+                            // A space looks the same in either character set.
+                            if (ch && cell_ascii != last_ascii) {
+                                output += charset_sequence(cell_ascii);
+                                last_ascii = cell_ascii;
+                            }
+                            output += ch ? ch : ' ';
+                        }
+                    }
+                    if (colors)
+                        output += sgr_sequence(rendition > 7, false, rendition);
+                    else
+                        output += sgr_sequence(rendition == int(color::mono_bright), rendition == int(color::mono_blinking), 0);
+                    output += charset_sequence(ascii);
+                    if (cursor_y > 0 && cursor_x > 0)
+                        output += "\033[" + std::to_string(cursor_y) + ";" + std::to_string(cursor_x) + "H";
+                    std::printf("[%.6f, \"o\", %s]\n", seconds, json_string(output).c_str());
+                }
+            }
+            offset += record_length;
+        }
+        return true;
+    }
+
+}  // namespace
+
+int main(const int argc, const char* argv[])
+{
+    auto asciicast = false;
+    auto from_seconds = 0.0;
+    auto path = std::string{};
+    auto valid = true;
+    for (auto i = 1; i < argc; i++) {
+        const auto arg = std::string{argv[i]};
+        if (arg == "--asciicast") {
+            asciicast = true;
+        } else if (arg == "--from" && i + 1 < argc) {
+            try {
+                from_seconds = std::stod(argv[++i]);
+                // This also rules out NaN, which fails every comparison.
+                valid = valid && from_seconds >= 0 && from_seconds < 1e9;
+            } catch (std::exception) {
+                valid = false;
+            }
+        } else {
+            path = arg;
+        }
+    }
+    if (path.empty() || !valid) {
+        std::cout << "Usage: vtnibbler_trace [--asciicast] [--from SECONDS] FILE\n";
+        return 1;
+    }
+
+    auto file = std::ifstream{path, std::ios::binary};
+    auto trace = trace_reader{{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}}};
+    if (!trace.valid()) {
+        std::cout << "vtnibbler_trace: '" << path << "' is not a trace file\n";
+        return 1;
+    }
+
+    const auto offset = trace.seek(static_cast<uint64_t>(from_seconds * 1'000'000));
+    const auto complete = asciicast ? export_asciicast(trace, offset) : summarize(trace, offset);
+    if (!complete) {
+        std::cerr << "vtnibbler_trace: '" << path << "' is truncated\n";
+        return 1;
+    }
+    return 0;
+}